@@ -1,17 +1,41 @@
 // Copyright (c) 2020 udv. All rights reserved.
 
+#include <cerrno>
+#include <cstddef>
 #include <cstdio>
 #include <cstring>
-#include <ctime>
+#include <type_traits>
 
 #include "chip8.hpp"
 
 namespace chip8 {
-	chip8::chip8() = default;
-	chip8::~chip8() = default;
+	//region Layout checks
+	// A member function, so the checks can see the private state
+	void chip8::check_layout() noexcept {
+		static_assert(alignof(chip8) == 64, "chip8 must start on a cache line");
+		static_assert(std::is_standard_layout<chip8>::value, "offsetof needs a standard-layout chip8");
+		static_assert(offsetof(chip8, opcode) == 0, "opcode must lead the hot line");
+		static_assert(offsetof(chip8, stack) + sizeof(chip8::stack) <= 64,
+		              "registers, timers and stack must share cache line 0");
+		static_assert(offsetof(chip8, key_wait) + sizeof(chip8::key_wait) <= 64,
+		              "keypad state must share cache line 0");
+		static_assert(offsetof(chip8, rng_state) == 64, "generator must sit on cache line 1");
+		static_assert(offsetof(chip8, memory) % 64 == 0, "memory must be line aligned");
+		static_assert(offsetof(chip8, gfx) % 64 == 0, "framebuffer must be line aligned");
+		static_assert(offsetof(chip8, memory) > offsetof(chip8, key_wait), "memory must follow the hot state");
+		static_assert(std::is_trivially_copyable<chip8>::value, "snapshots copy chip8 byte-wise");
+	}
+	//endregion
+
+	size_t chip8::framebuffer_offset() noexcept { return offsetof(chip8, gfx); }
 
 	void chip8::cycle() noexcept {
-		opcode = memory[pc] << 8 | memory[pc + 1];
+		if (key_wait != 0) {
+			tick_timers();
+			return;
+		}
+
+		opcode = memory[pc & 0xFFFu] << 8 | memory[(pc + 1) & 0xFFFu];
 
 		switch (opcode & 0xF000) {
 			case 0x0000: {
@@ -83,6 +107,10 @@ namespace chip8 {
 				break;
 		}
 
+		tick_timers();
+	}
+
+	void chip8::tick_timers() noexcept {
 		if (delay_timer > 0) {
 			--delay_timer;
 		}
@@ -94,20 +122,48 @@ namespace chip8 {
 		}
 	}
 
-	void chip8::next_instruction() noexcept { pc += 2; }
+	void chip8::set_keys(uint16_t mask) noexcept {
+		uint16_t pressed = mask & ~keys;
+		keys = mask;
+
+		if (key_wait != 0 && pressed != 0) {
+			V[key_wait & 0x0Fu] = highest_key(pressed);
+			key_wait = 0;
+		}
+	}
+
+	void chip8::seed(uint64_t value) noexcept {
+		rng_seed = value;
+
+		// pcg32_srandom: advance once, mix in the seed, advance again
+		rng_state = 0;
+		random();
+		rng_state += value;
+		random();
+	}
+
+	bool chip8::valid() const noexcept {
+		return pc <= memory_size - 1 && sp <= stack_depth && I <= memory_size - 1 &&
+		       (key_wait == 0 || (key_wait & ~0x0Fu) == key_wait_flag);
+	}
+
+	void chip8::next_instruction() noexcept { pc = (pc + 2) & 0x0FFFu; }
 
 	void chip8::unknown_opcode_error() const noexcept { printf("Unknown opcode: 0x%X\n", opcode); }
 
+	void chip8::stack_error(const char *what) const noexcept {
+		printf("Stack %s: 0x%X at 0x%03X\n", what, opcode, pc);
+	}
+
 	bool chip8::load_game(const char *filename) {
 		init();
 		printf("Loading: %s\n", filename);
 
 		// Open file
-		FILE *file;
-		errno_t error;
-		if ((error = fopen_s(&file, filename, "rb")) != 0) {
+		FILE *file = fopen(filename, "rb");
+		if (file == nullptr) {
 			fprintf(stderr, "cannot open file '%s': %s\n",
-			        filename, strerror(error));
+			        filename, strerror(errno));
 			return false;
 		}
 
@@ -117,39 +173,38 @@ namespace chip8 {
 		rewind(file);
 		printf("Filesize: %d\n", (int) lSize);
 
-		// Allocate memory to contain the whole file
-		char *buffer = (char *) malloc(sizeof(char) * lSize);
-		if (buffer == nullptr) {
-			fputs("Memory error", stderr);
+		if (lSize < 0 || (size_t) lSize > sizeof(memory) - program_start) {
+			fputs("Error: ROM too big for memory\n", stderr);
+			fclose(file);
 			return false;
 		}
 
-		// Copy the file into the buffer
-		size_t result = fread(buffer, 1, lSize, file);
-		if (result != lSize) {
-			fputs("Reading error", stderr);
+		// Read the file straight into Chip8 memory
+		size_t result = fread(memory + program_start, 1, lSize, file);
+		fclose(file);
+		if (result != (size_t) lSize) {
+			fputs("Reading error\n", stderr);
 			return false;
 		}
+		return true;
+	}
 
-		// Copy buffer to Chip8 memory
-		if ((4096 - 512) > lSize) {
-			for (int i = 0; i < lSize; ++i) {
-				memory[i + 512] = buffer[i];
-			}
-		} else {
-			printf("Error: ROM too big for memory");
+	bool chip8::load_rom(const unsigned char *rom, size_t size) noexcept {
+		init();
+
+		if (size > sizeof(memory) - program_start) {
+			fputs("Error: ROM too big for memory\n", stderr);
+			return false;
 		}
-		free(buffer);
 
-		// Close file, free buffer
-		fclose(file);
+		memcpy(memory + program_start, rom, size);
 		return true;
 	}
 
 	void chip8::init() noexcept {
-		srand(time(nullptr));
+		seed(rng_seed);
 
-		pc = 0x200;
+		pc = program_start;
 		opcode = 0;
 		I = 0;
 		sp = 0;
@@ -164,10 +219,13 @@ namespace chip8 {
 			i = 0;
 		}
 
-		for (int i = 0; i < 16; ++i) {
-			key[i] = V[i] = 0;
+		for (unsigned char &i : V) {
+			i = 0;
 		}
 
+		keys = 0;
+		key_wait = 0;
+
 		// Clear memory
 		for (unsigned char &i : memory) {
 			i = 0;
@@ -3,8 +3,12 @@
 #ifndef CHIP8
 #define CHIP8
 
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+
+#include "tables.hpp"
 
 #define CHIP8_DISPLAY_WIDTH_DEFAULT 64
 #define CHIP8_DISPLAY_HEIGHT_DEFAULT 32
@@ -37,7 +41,7 @@ namespace chip8 {
 			0xF0, 0x80, 0xF0, 0x80, 0x80  //F
 	};
 
-	class chip8 {
+	class alignas(64) chip8 {
 	private:
 		struct instructions {
 			// 00E0: clear the screen
@@ -51,8 +55,13 @@ namespace chip8 {
 
 			// 00EE: returns from subroutine
 			INSTRUCTION(00EE) {
+				if (c.sp == 0) {
+					c.stack_error("underflow");
+					c.next_instruction();
+					return;
+				}
 				--c.sp;
-				c.pc = c.stack[c.sp];
+				c.pc = c.stack[c.sp] & 0x0FFFu;
 				c.next_instruction();
 			}
 
@@ -63,6 +72,11 @@ namespace chip8 {
 
 			// Calls subroutine at NNN
 			INSTRUCTION(2NNN) {
+				if (c.sp >= stack_depth) {
+					c.stack_error("overflow");
+					c.next_instruction();
+					return;
+				}
 				c.stack[c.sp] = c.pc;
 				++c.sp;
 				c.pc = c.opcode & 0x0FFFu;
@@ -199,13 +213,13 @@ namespace chip8 {
 
 			// Jumps to the address NNN plus V0.
 			INSTRUCTION(BNNN) {
-				c.pc = (c.opcode & 0x0FFFu) + c.V[0];
+				c.pc = ((c.opcode & 0x0FFFu) + c.V[0]) & 0x0FFFu;
 			}
 
 			// Sets VX to the result of a bitwise and operation on a random number
 			// (Typically: 0 to 255) and NN.
 			INSTRUCTION(CXNN) {
-				c.V[(c.opcode & 0x0F00u) >> 8u] = (rand() % 0xFFu) & (c.opcode & 0x00FFu);
+				c.V[(c.opcode & 0x0F00u) >> 8u] = (c.random() & 0xFFu) & (c.opcode & 0x00FFu);
 				c.next_instruction();
 			}
 
@@ -217,20 +231,34 @@ namespace chip8 {
 			// to 1 if any screen pixels are flipped from set to unset when the sprite is drawn,
 			// and to 0 if that doesn’t happen
 			INSTRUCTION(DXYN) {
-				unsigned short x = c.V[(c.opcode & 0x0F00u) >> 8u];
-				unsigned short y = c.V[(c.opcode & 0x00F0u) >> 4u];
-				unsigned short height = c.opcode & 0x000Fu;
-				unsigned short pixel;
+				unsigned int x = c.V[(c.opcode & 0x0F00u) >> 8u];
+				unsigned int y = c.V[(c.opcode & 0x00F0u) >> 4u];
+				unsigned int height = c.opcode & 0x000Fu;
 
 				c.V[0xF] = 0;
 				for (unsigned int yline = 0; yline < height; yline++) {
-					pixel = c.memory[c.I + yline];
+					const tables::pixel_row &row = tables::expand[c.memory[(c.I + yline) & 0xFFFu]];
+					unsigned int offset = x + ((y + yline) * DISPLAY_WIDTH);
+
+					if (x + 8 <= DISPLAY_WIDTH && offset + 8 <= DISPLAY_SIZE) {
+						// Whole row on screen: test and flip all eight pixels at once
+						uint64_t sprite, screen;
+						memcpy(&sprite, row.pixels, sizeof(sprite));
+						memcpy(&screen, c.gfx + offset, sizeof(screen));
+						if ((screen & sprite) != 0) {
+							c.V[0xF] = 1;
+						}
+						screen ^= sprite;
+						memcpy(c.gfx + offset, &screen, sizeof(screen));
+						continue;
+					}
+
 					for (unsigned int xline = 0; xline < 8; xline++) {
-						if ((pixel & (0x80u >> xline)) != 0) {
-							if (c.gfx[(x + xline + ((y + yline) * DISPLAY_WIDTH))] == 1) {
+						if (row.pixels[xline] != 0 && offset + xline < DISPLAY_SIZE) {
+							if (c.gfx[offset + xline] == 1) {
 								c.V[0xF] = 1;
 							}
-							c.gfx[x + xline + ((y + yline) * DISPLAY_WIDTH)] ^= 1u;
+							c.gfx[offset + xline] ^= 1u;
 						}
 					}
 				}
@@ -243,7 +271,7 @@ namespace chip8 {
 			// (Usually the next instruction is a jump to skip a code block)
 			INSTRUCTION(EX9E) {
 				c.next_instruction();
-				if (c.key[c.V[(c.opcode & 0x0F00u) >> 8u]] != 0) {
+				if (c.key_pressed(c.V[(c.opcode & 0x0F00u) >> 8u])) {
 					c.next_instruction();
 				}
 			}
@@ -252,7 +280,7 @@ namespace chip8 {
 			// (Usually the next instruction is a jump to skip a code block)
 			INSTRUCTION(EXA1) {
 				c.next_instruction();
-				if (c.key[c.V[(c.opcode & 0x0F00u) >> 8u]] == 0) {
+				if (!c.key_pressed(c.V[(c.opcode & 0x0F00u) >> 8u])) {
 					c.next_instruction();
 				}
 			}
@@ -266,21 +294,16 @@ namespace chip8 {
 			// A key press is awaited, and then stored in VX.
 			// (Blocking Operation. All instruction halted until next key event)
 			INSTRUCTION(FX0A) {
-				bool keyPress = false;
-
-				for (int i = 0; i < 16; ++i) {
-					if (c.key[i] != 0) {
-						c.V[(c.opcode & 0x0F00u) >> 8u] = i;
-						keyPress = true;
-					}
-				}
+				c.next_instruction();
 
-				// If we didn't received a keypress, skip this cycle and try again.
-				if (!keyPress) {
+				// A key already held satisfies the wait immediately
+				if (c.keys != 0) {
+					c.V[(c.opcode & 0x0F00u) >> 8u] = highest_key(c.keys);
 					return;
 				}
 
-				c.next_instruction();
+				// Otherwise halt; the next key_down()/set_keys() press resumes execution.
+				c.key_wait = key_wait_flag | ((c.opcode & 0x0F00u) >> 8u);
 			}
 
 			// Sets the delay timer to VX.
@@ -302,14 +325,14 @@ namespace chip8 {
 				} else {
 					c.V[0xF] = 0;
 				}
-				c.I += c.V[(c.opcode & 0x0F00u) >> 8u];
+				c.I = (c.I + c.V[(c.opcode & 0x0F00u) >> 8u]) & 0x0FFFu;
 				c.next_instruction();
 			}
 
 			// Sets I to the location of the sprite for the character in VX.
 			// Characters 0-F (in hexadecimal) are represented by a 4x5 font.
 			INSTRUCTION(FX29) {
-				c.I = c.V[(c.opcode & 0x0F00u) >> 8u] * 0x5u;
+				c.I = tables::font_address[c.V[(c.opcode & 0x0F00u) >> 8u]];
 				c.next_instruction();
 			}
 
@@ -321,9 +344,10 @@ namespace chip8 {
 			// place the hundreds digit in memory at location in I,
 			// the tens digit at location I + 1, and the ones digit at location I + 2.)
 			INSTRUCTION(FX33) {
-				c.memory[c.I] = c.V[(c.opcode & 0x0F00u) >> 8u] / 100;
-				c.memory[c.I + 1] = (c.V[(c.opcode & 0x0F00u) >> 8u] / 10) % 10;
-				c.memory[c.I + 2] = (c.V[(c.opcode & 0x0F00u) >> 8u] % 100) % 10;
+				const tables::bcd_digits &digits = tables::bcd[c.V[(c.opcode & 0x0F00u) >> 8u]];
+				c.memory[c.I & 0xFFFu] = digits.hundreds;
+				c.memory[(c.I + 1) & 0xFFFu] = digits.tens;
+				c.memory[(c.I + 2) & 0xFFFu] = digits.ones;
 				c.next_instruction();
 			}
 
@@ -331,12 +355,12 @@ namespace chip8 {
 			// The offset from I is increased by 1 for each value written,
 			// but I itself is left unmodified.
 			INSTRUCTION(FX55) {
-				for (int i = 0; i <= ((c.opcode & 0x0F00u) >> 8u); ++i) {
-					c.memory[c.I + i] = c.V[i];
+				for (unsigned int i = 0; i <= ((c.opcode & 0x0F00u) >> 8u); ++i) {
+					c.memory[(c.I + i) & 0xFFFu] = c.V[i];
 				}
 
 				// On the original interpreter, when the operation is done, I = I + X + 1.
-				c.I += ((c.opcode & 0x0F00u) >> 8u) + 1;
+				c.I = (c.I + ((c.opcode & 0x0F00u) >> 8u) + 1) & 0x0FFFu;
 				c.next_instruction();
 			}
 
@@ -344,49 +368,137 @@ namespace chip8 {
 			// The offset from I is increased by 1 for each value written,
 			// but I itself is left unmodified.
 			INSTRUCTION(FX65) {
-				for (int i = 0; i <= ((c.opcode & 0x0F00u) >> 8u); ++i) {
-					c.V[i] = c.memory[c.I + i];
+				for (unsigned int i = 0; i <= ((c.opcode & 0x0F00u) >> 8u); ++i) {
+					c.V[i] = c.memory[(c.I + i) & 0xFFFu];
 				}
 
 				// On the original interpreter, when the operation is done, I = I + X + 1.
-				c.I += ((c.opcode & 0x0F00u) >> 8u) + 1;
+				c.I = (c.I + ((c.opcode & 0x0F00u) >> 8u) + 1) & 0x0FFFu;
 				c.next_instruction();
 			}
 		};
 
 	public:
-		chip8();
-		~chip8();
+		chip8() = default;
+		~chip8() = default;
 
-		bool draw;
+		static constexpr uint16_t program_start = 0x200;
 
 		void cycle() noexcept;
 		bool load_game(const char *filename);
-
-		unsigned char gfx[CHIP8_DISPLAY_SIZE_DEFAULT];  // 64x32 display
-		unsigned char key[16];       // HEX-based keypad
-
+		// Loads a ROM image already in memory; does not allocate.
+		bool load_rom(const unsigned char *rom, size_t size) noexcept;
+
+		// Keypad input. Bit N of the mask is key N.
+		void set_keys(uint16_t mask) noexcept;
+		void key_down(unsigned int k) noexcept { set_keys(keys | (1u << (k & 0xFu))); }
+		void key_up(unsigned int k) noexcept { keys &= ~(1u << (k & 0xFu)); }
+		bool key_pressed(unsigned int k) const noexcept { return (keys >> (k & 0xFu)) & 0x1u; }
+		// True while FX0A is halted waiting for a key press.
+		bool waiting_for_key() const noexcept { return key_wait != 0; }
+
+		// Seeds CXNN's generator. The seed survives load_game/load_rom, so
+		// reloading a ROM replays the same random sequence.
+		void seed(uint64_t value) noexcept;
+
+		// True if the registers describe a state cycle() can run from; used to
+		// vet snapshots that arrive from outside before they replace this one.
+		bool valid() const noexcept;
+
+		//region State access
+		// Read-only views for the debugger, tracer, control server and front ends;
+		// only the interpreter writes machine state.
+		static constexpr size_t memory_size = 4096;
+		static constexpr size_t stack_depth = 16;
+
+		uint16_t current_opcode() const noexcept { return opcode; }
+		uint16_t program_counter() const noexcept { return pc; }
+		uint16_t index_register() const noexcept { return I; }
+		uint16_t stack_pointer() const noexcept { return sp; }
+		const unsigned char *registers() const noexcept { return V; }
+		unsigned char delay() const noexcept { return delay_timer; }
+		unsigned char sound() const noexcept { return sound_timer; }
+		const uint16_t *call_stack() const noexcept { return stack; }
+		uint16_t key_mask() const noexcept { return keys; }
+		uint64_t current_seed() const noexcept { return rng_seed; }
+		const unsigned char *ram() const noexcept { return memory; }
+		const unsigned char *framebuffer() const noexcept { return gfx; }
+
+		// Set by 00E0/DXYN; a front end clears it once it has shown the frame.
+		bool draw_pending() const noexcept { return draw; }
+		void clear_draw() noexcept { draw = false; }
+
+		// Byte offset of the framebuffer, for readers of a shared-memory copy.
+		static size_t framebuffer_offset() noexcept;
+		//endregion
 
 	private:
-		void init() noexcept;
-
-		uint16_t opcode;             // 35 opcodes
-		unsigned char memory[4096];  // 4K memory
-		unsigned char V[16];         // 15 8-bit registers (V0 - VE)
-
-		uint16_t I;                  // Index register
-		uint16_t pc;                 // Program Counter
-
+		// Machine state, ordered hot to cold. Everything cycle() touches on
+		// nearly every instruction lives in the first cache line; memory and
+		// the framebuffer follow on their own lines. pc and I are kept to 12 bits
+		// and memory indices wrap at 4K, so no ROM can address outside memory.
+
+		//region Hot: registers, stack, timers and keypad (cache line 0)
+		alignas(64)
+		uint16_t opcode = 0;         // 35 opcodes
+		uint16_t pc = 0;             // Program Counter
+		uint16_t I = 0;              // Index register
+		uint16_t sp = 0;             // Stack pointer
+		unsigned char V[16]{};       // 15 8-bit registers (V0 - VE)
 
 		// Interrupts and hardware registers
-		unsigned char delay_timer;
-		unsigned char sound_timer;
+		unsigned char delay_timer = 0;
+		unsigned char sound_timer = 0;
+
+		bool draw = false;
+
+		uint16_t stack[stack_depth]{}; // 16 levels of stack
+
+		uint16_t keys = 0;           // HEX-based keypad, bit N = key N
+		unsigned char key_wait = 0;  // key_wait_flag | X while FX0A waits, else 0
+		//endregion
+		//region Warm: random number generator (cache line 1)
+		alignas(64)
+		uint64_t rng_state = 0;      // PCG32 state
+		uint64_t rng_seed = 0;       // Seed restored by init()
+		//endregion
+		//region Cold: memory and framebuffer
+		alignas(64)
+		unsigned char memory[memory_size]{};  // 4K memory
+		alignas(64)
+		unsigned char gfx[CHIP8_DISPLAY_SIZE_DEFAULT]{};  // 64x32 display
+		//endregion
+
+		static constexpr unsigned char key_wait_flag = 0x80;
+
+		static unsigned char highest_key(uint16_t mask) noexcept {
+			unsigned char k = 15;
+			while ((mask & (1u << k)) == 0) {
+				--k;
+			}
+			return k;
+		}
+
+		// PCG32 (XSH RR), fixed stream
+		static constexpr uint64_t rng_multiplier = 6364136223846793005ULL;
+		static constexpr uint64_t rng_increment = 1442695040888963407ULL;
+
+		uint32_t random() noexcept {
+			uint64_t old = rng_state;
+			rng_state = old * rng_multiplier + rng_increment;
+			auto xorshifted = (uint32_t) (((old >> 18u) ^ old) >> 27u);
+			auto rotation = (uint32_t) (old >> 59u);
+			return (xorshifted >> rotation) | (xorshifted << ((32u - rotation) & 31u));
+		}
 
-		uint16_t stack[16];          // 16 levels of stack
-		uint16_t sp;                 // Stack pointer
+		void init() noexcept;
+		// Compile-time checks of the member layout above (never called)
+		static void check_layout() noexcept;
 
 		void next_instruction() noexcept;
+		void tick_timers() noexcept;
 		void unknown_opcode_error() const noexcept;
+		void stack_error(const char *what) const noexcept;
 	};
 }
 
@@ -0,0 +1,65 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_CONTROL_PROTOCOL
+#define CHIP8_CONTROL_PROTOCOL
+
+#include <cstdint>
+
+// Binary protocol spoken over the control socket.
+// Every message is a fixed header followed by `length` bytes of payload,
+// in host byte order (the socket is local). A client may write any number of
+// requests back to back; the server answers each, in order, and flushes all
+// replies for one read with a single write.
+namespace chip8 {
+	namespace control {
+		enum class op : uint8_t {
+			attach = 1,            // -> shm name (NUL-terminated) and region size
+			load_rom = 2,          // ROM bytes ->
+			set_keys = 3,          // uint16_t key mask (bit N = key N) ->
+			step = 4,              // uint32_t cycles -> uint8_t draw flag
+			read_framebuffer = 5,  // -> framebuffer_view
+			read_registers = 6,    // -> registers
+			snapshot = 7,          // -> raw machine state
+			restore = 8,           // raw machine state ->
+			seed = 9,              // uint64_t seed for CXNN ->
+		};
+
+		enum class status : uint8_t {
+			ok = 0,
+			bad_request = 1,
+			unknown_op = 2,
+			failed = 3,
+		};
+
+		struct header {
+			op code;
+			status result;         // Always ok in requests
+			uint16_t reserved;
+			uint32_t length;       // Payload bytes following the header
+		};
+		static_assert(sizeof(header) == 8, "header must stay 8 bytes");
+
+		// Location of the live framebuffer inside the attached shared-memory region.
+		// One byte per pixel, row-major, DISPLAY_WIDTH x DISPLAY_HEIGHT.
+		struct framebuffer_view {
+			uint32_t offset;
+			uint32_t size;
+		};
+
+		struct registers {
+			uint16_t pc;
+			uint16_t I;
+			uint16_t sp;
+			uint16_t opcode;
+			uint8_t V[16];
+			uint8_t delay_timer;
+			uint8_t sound_timer;
+			uint16_t stack[16];
+		};
+
+		// Upper bound on a single message payload; snapshots are the largest.
+		constexpr uint32_t max_payload = 16u * 1024u;
+	}
+}
+
+#endif //CHIP8_CONTROL_PROTOCOL
@@ -0,0 +1,283 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "control_server.hpp"
+
+namespace chip8 {
+	namespace control {
+		static_assert(sizeof(chip8) <= max_payload, "snapshots must fit in one message");
+
+		server::~server() {
+			if (listener >= 0) {
+				close(listener);
+				unlink(socket_name.c_str());
+			}
+			if (instance != nullptr) {
+				instance->~chip8();
+				munmap(instance, sizeof(chip8));
+			}
+			if (shm_fd >= 0) {
+				close(shm_fd);
+				shm_unlink(shm_name.c_str());
+			}
+		}
+
+		bool server::open(const char *socket_path) {
+			//region Shared memory
+			shm_name = "/chip8-ctl-" + std::to_string(getpid());
+			shm_fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (shm_fd < 0) {
+				fprintf(stderr, "cannot create shared memory '%s': %s\n", shm_name.c_str(), strerror(errno));
+				return false;
+			}
+			if (ftruncate(shm_fd, sizeof(chip8)) != 0) {
+				fprintf(stderr, "cannot size shared memory: %s\n", strerror(errno));
+				return false;
+			}
+			void *region = mmap(nullptr, sizeof(chip8), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+			if (region == MAP_FAILED) {
+				fprintf(stderr, "cannot map shared memory: %s\n", strerror(errno));
+				return false;
+			}
+			instance = new(region) chip8{};
+			//endregion
+			//region Socket
+			sockaddr_un address{};
+			address.sun_family = AF_UNIX;
+			if (strlen(socket_path) >= sizeof(address.sun_path)) {
+				fprintf(stderr, "socket path too long: '%s'\n", socket_path);
+				return false;
+			}
+			strcpy(address.sun_path, socket_path);
+
+			listener = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (listener < 0) {
+				fprintf(stderr, "cannot create socket: %s\n", strerror(errno));
+				return false;
+			}
+			unlink(socket_path);
+			if (bind(listener, (sockaddr *) &address, sizeof(address)) != 0 || listen(listener, 1) != 0) {
+				fprintf(stderr, "cannot listen on '%s': %s\n", socket_path, strerror(errno));
+				close(listener);
+				listener = -1;
+				return false;
+			}
+			socket_name = socket_path;
+			//endregion
+			return true;
+		}
+
+		bool server::run() {
+			running = 1;
+			while (running) {
+				int client = accept(listener, nullptr, nullptr);
+				if (client < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					fprintf(stderr, "accept failed: %s\n", strerror(errno));
+					return false;
+				}
+				serve(client);
+				close(client);
+			}
+			return true;
+		}
+
+		bool server::serve(int client) {
+			std::vector<unsigned char> in(sizeof(header) + max_payload);
+			size_t filled = 0;
+
+			while (running) {
+				ssize_t received = read(client, in.data() + filled, in.size() - filled);
+				if (received < 0 && errno == EINTR) {
+					continue;
+				}
+				if (received <= 0) {
+					return received == 0;
+				}
+				filled += received;
+
+				bool rejected = false;
+				size_t consumed = dispatch(in.data(), filled, rejected);
+				memmove(in.data(), in.data() + consumed, filled - consumed);
+				filled -= consumed;
+
+				// One write per batch of requests
+				size_t sent = 0;
+				while (sent < out.size()) {
+					ssize_t written = send(client, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+					if (written < 0 && errno == EINTR) {
+						continue;
+					}
+					if (written <= 0) {
+						out.clear();
+						return false;
+					}
+					sent += written;
+				}
+				out.clear();
+				if (rejected) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		size_t server::dispatch(const unsigned char *in, size_t size, bool &rejected) {
+			size_t offset = 0;
+			while (size - offset >= sizeof(header)) {
+				header request;
+				memcpy(&request, in + offset, sizeof(header));
+				if (request.length > max_payload) {
+					// The payload can never fit; the stream cannot resync past it.
+					current = request.code;
+					reply(status::bad_request);
+					rejected = true;
+					break;
+				}
+				if (size - offset - sizeof(header) < request.length) {
+					break;
+				}
+
+				handle(request, in + offset + sizeof(header));
+				offset += sizeof(header) + request.length;
+			}
+			return offset;
+		}
+
+		void server::handle(const header &request, const unsigned char *payload) {
+			chip8 &c = *instance;
+			current = request.code;
+
+			switch (request.code) {
+				case op::attach: {
+					std::vector<unsigned char> info(sizeof(uint32_t) + shm_name.size() + 1);
+					uint32_t region_size = sizeof(chip8);
+					memcpy(info.data(), &region_size, sizeof(region_size));
+					memcpy(info.data() + sizeof(region_size), shm_name.c_str(), shm_name.size() + 1);
+					reply(status::ok, info.data(), info.size());
+					break;
+				}
+
+				case op::load_rom: {
+					reply(c.load_rom(payload, request.length) ? status::ok : status::failed);
+					break;
+				}
+
+				case op::set_keys: {
+					uint16_t mask;
+					if (request.length != sizeof(mask)) {
+						reply(status::bad_request);
+						break;
+					}
+					memcpy(&mask, payload, sizeof(mask));
+					c.set_keys(mask);
+					reply(status::ok);
+					break;
+				}
+
+				case op::step: {
+					uint32_t cycles;
+					if (request.length != sizeof(cycles)) {
+						reply(status::bad_request);
+						break;
+					}
+					memcpy(&cycles, payload, sizeof(cycles));
+
+					uint8_t draw = 0;
+					for (uint32_t i = 0; i < cycles; ++i) {
+						c.cycle();
+						draw |= c.draw_pending();
+						c.clear_draw();
+					}
+					reply(status::ok, &draw, sizeof(draw));
+					break;
+				}
+
+				case op::read_framebuffer: {
+					framebuffer_view view{(uint32_t) chip8::framebuffer_offset(), DISPLAY_SIZE};
+					reply(status::ok, &view, sizeof(view));
+					break;
+				}
+
+				case op::read_registers: {
+					registers r{};
+					r.pc = c.program_counter();
+					r.I = c.index_register();
+					r.sp = c.stack_pointer();
+					r.opcode = c.current_opcode();
+					memcpy(r.V, c.registers(), sizeof(r.V));
+					r.delay_timer = c.delay();
+					r.sound_timer = c.sound();
+					memcpy(r.stack, c.call_stack(), sizeof(r.stack));
+					reply(status::ok, &r, sizeof(r));
+					break;
+				}
+
+				case op::snapshot: {
+					reply(status::ok, &c, sizeof(chip8));
+					break;
+				}
+
+				case op::restore: {
+					if (request.length != sizeof(chip8)) {
+						reply(status::bad_request);
+						break;
+					}
+					// Vet a copy first so a corrupt snapshot leaves the live instance untouched
+					chip8 incoming;
+					memcpy(&incoming, payload, sizeof(chip8));
+					if (!incoming.valid()) {
+						reply(status::bad_request);
+						break;
+					}
+					memcpy(&c, &incoming, sizeof(chip8));
+					reply(status::ok);
+					break;
+				}
+
+				case op::seed: {
+					uint64_t value;
+					if (request.length != sizeof(value)) {
+						reply(status::bad_request);
+						break;
+					}
+					memcpy(&value, payload, sizeof(value));
+					c.seed(value);
+					reply(status::ok);
+					break;
+				}
+
+				default:
+					reply(status::unknown_op);
+					break;
+			}
+		}
+
+		void server::reply(status result, const void *payload, uint32_t length) {
+			header response{};
+			response.code = current;
+			response.result = result;
+			response.length = length;
+
+			size_t at = out.size();
+			out.resize(at + sizeof(header) + length);
+			memcpy(out.data() + at, &response, sizeof(header));
+			if (length != 0) {
+				memcpy(out.data() + at + sizeof(header), payload, length);
+			}
+		}
+	}
+}
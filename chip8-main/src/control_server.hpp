@@ -0,0 +1,58 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_CONTROL_SERVER
+#define CHIP8_CONTROL_SERVER
+
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "control_protocol.hpp"
+
+namespace chip8 {
+	namespace control {
+		// Drives one emulator instance over a Unix-domain socket.
+		// The instance itself lives in a POSIX shared-memory region so clients
+		// can map it and read the framebuffer without it crossing the socket.
+		class server {
+		public:
+			server() = default;
+			~server();
+
+			server(const server &) = delete;
+			server &operator=(const server &) = delete;
+
+			bool open(const char *socket_path);
+			// Accepts clients one at a time and serves them until `stop()` or an error.
+			bool run();
+			// Safe to call from a signal handler.
+			void stop() noexcept { running = 0; }
+
+			chip8 &emulator() noexcept { return *instance; }
+
+		private:
+			bool serve(int client);
+			// Handles every complete request in `in`, appending replies to `out`.
+			// Returns the number of bytes consumed; sets `rejected` if a header
+			// announced an oversized payload, after which the connection must close.
+			size_t dispatch(const unsigned char *in, size_t size, bool &rejected);
+			void handle(const header &request, const unsigned char *payload);
+			void reply(status result, const void *payload = nullptr, uint32_t length = 0);
+
+			int listener = -1;
+			int shm_fd = -1;
+			chip8 *instance = nullptr;
+			volatile sig_atomic_t running = 0;
+			op current = op::attach;     // Request being answered
+
+			std::string socket_name;
+			std::string shm_name;
+			std::vector<unsigned char> out;
+		};
+	}
+}
+
+#endif //CHIP8_CONTROL_SERVER
@@ -0,0 +1,193 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "chip8.hpp"
+#include "debugger.hpp"
+
+//region Emulator
+chip8::chip8 *emulator;
+//endregion
+
+const char *reason_name(chip8::debug::stop_reason reason) {
+	switch (reason) {
+		case chip8::debug::stop_reason::step: return "step";
+		case chip8::debug::stop_reason::breakpoint: return "breakpoint";
+		case chip8::debug::stop_reason::watchpoint: return "watchpoint";
+		case chip8::debug::stop_reason::condition: return "condition";
+		case chip8::debug::stop_reason::cycle_limit: return "cycle limit";
+		default: return "unknown";
+	}
+}
+
+uint16_t next_opcode(const chip8::chip8 &c) {
+	return c.ram()[c.program_counter() & 0xFFFu] << 8u | c.ram()[(c.program_counter() + 1) & 0xFFFu];
+}
+
+void print_stop(const chip8::debug::debugger &dbg, chip8::debug::stop_reason reason) {
+	printf("[%s] pc=%03X next=%04X cycles=%llu", reason_name(reason), emulator->program_counter(), next_opcode(*emulator),
+	       (unsigned long long) dbg.cycles());
+	if (reason == chip8::debug::stop_reason::watchpoint) {
+		printf(" write to %03X", dbg.watch_address());
+	} else if (reason == chip8::debug::stop_reason::condition) {
+		printf(" condition #%zu", dbg.condition_index());
+	}
+	putchar('\n');
+}
+
+void print_registers(const chip8::chip8 &c) {
+	for (int i = 0; i < 16; ++i) {
+		printf("V%X=%02X%s", i, c.registers()[i], i % 8 == 7 ? "\n" : " ");
+	}
+	printf("I=%03X pc=%03X sp=%X DT=%02X ST=%02X keys=%04X%s\n", c.index_register(), c.program_counter(), c.stack_pointer(), c.delay(),
+	       c.sound(), c.key_mask(), c.waiting_for_key() ? " (waiting for key)" : "");
+}
+
+void print_memory(const chip8::chip8 &c, unsigned long address, unsigned long length) {
+	for (unsigned long i = 0; i < length; ++i) {
+		if (i % 16 == 0) {
+			printf("%s%03lX:", i == 0 ? "" : "\n", (address + i) & 0xFFFu);
+		}
+		printf(" %02X", c.ram()[(address + i) & 0xFFFu]);
+	}
+	putchar('\n');
+}
+
+void print_help() {
+	printf("  b ADDR            set breakpoint          d ADDR       delete breakpoint\n"
+	       "  w ADDR [LEN]      watch FX33/FX55 writes   uw ADDR [LEN] remove watch\n"
+	       "  cond REG OP [VAL] stop when REG (V0-VF, I) OP (==, !=, changed) VAL\n"
+	       "  cond clear        remove all conditions\n"
+	       "  s                 step in                 n            step over 2NNN\n"
+	       "  f                 finish subroutine       c [N]        continue (max N cycles, decimal)\n"
+	       "  r                 registers               bt           call stack\n"
+	       "  x ADDR [LEN]      dump memory             keys MASK    set keypad mask\n"
+	       "  q                 quit\n"
+	       "Addresses and values are hexadecimal.\n");
+}
+
+bool parse_condition(const char *reg, const char *op, const char *value, chip8::debug::condition &cond) {
+	if ((reg[0] == 'I' || reg[0] == 'i') && reg[1] == '\0') {
+		cond.what = chip8::debug::target::I;
+	} else if ((reg[0] == 'V' || reg[0] == 'v') && reg[1] != '\0' && reg[2] == '\0') {
+		char *end;
+		unsigned long index = strtoul(reg + 1, &end, 16);
+		if (*end != '\0') {
+			return false;
+		}
+		cond.what = (chip8::debug::target) index;
+	} else {
+		return false;
+	}
+
+	if (strcmp(op, "changed") == 0) {
+		cond.how = chip8::debug::compare::changed;
+		cond.value = 0;
+		return true;
+	}
+	if (strcmp(op, "==") == 0) {
+		cond.how = chip8::debug::compare::equal;
+	} else if (strcmp(op, "!=") == 0) {
+		cond.how = chip8::debug::compare::not_equal;
+	} else {
+		return false;
+	}
+	if (value == nullptr) {
+		return false;
+	}
+	cond.value = (uint16_t) strtoul(value, nullptr, 16);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	//region Setup
+	if (argc < 2) {
+		printf("Usage: chip8-debug <game_filename> [--seed N]\n\n");
+		return 65;
+	}
+
+	static chip8::chip8 instance{};
+	emulator = &instance;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			emulator->seed(strtoull(argv[++i], nullptr, 10));
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 65;
+		}
+	}
+
+	if (!emulator->load_game(argv[1])) {
+		return 1;
+	}
+
+	static chip8::debug::debugger dbg(*emulator);
+	printf("Type 'h' for help.\n");
+	//endregion
+
+	//region Command loop
+	char line[256];
+	while (printf("(chip8) "), fflush(stdout), fgets(line, sizeof(line), stdin) != nullptr) {
+		char *args[4] = {};
+		int count = 0;
+		for (char *token = strtok(line, " \t\r\n"); token != nullptr && count < 4; token = strtok(nullptr, " \t\r\n")) {
+			args[count++] = token;
+		}
+		if (count == 0) {
+			continue;
+		}
+
+		const char *command = args[0];
+		unsigned long arg1 = count > 1 ? strtoul(args[1], nullptr, 16) : 0;
+		unsigned long arg2 = count > 2 ? strtoul(args[2], nullptr, 16) : 1;
+
+		if (strcmp(command, "q") == 0) {
+			break;
+		} else if (strcmp(command, "h") == 0) {
+			print_help();
+		} else if (strcmp(command, "b") == 0 && count > 1) {
+			dbg.set_breakpoint((uint16_t) arg1);
+		} else if (strcmp(command, "d") == 0 && count > 1) {
+			dbg.clear_breakpoint((uint16_t) arg1);
+		} else if (strcmp(command, "w") == 0 && count > 1) {
+			dbg.watch((uint16_t) arg1, (uint16_t) arg2);
+		} else if (strcmp(command, "uw") == 0 && count > 1) {
+			dbg.unwatch((uint16_t) arg1, (uint16_t) arg2);
+		} else if (strcmp(command, "cond") == 0 && count == 2 && strcmp(args[1], "clear") == 0) {
+			dbg.clear_conditions();
+		} else if (strcmp(command, "cond") == 0 && count > 2) {
+			chip8::debug::condition cond{};
+			if (!parse_condition(args[1], args[2], args[3], cond) || !dbg.add_condition(cond)) {
+				printf("Invalid or too many conditions\n");
+			}
+		} else if (strcmp(command, "s") == 0) {
+			print_stop(dbg, dbg.step_in());
+		} else if (strcmp(command, "n") == 0) {
+			print_stop(dbg, dbg.step_over());
+		} else if (strcmp(command, "f") == 0) {
+			print_stop(dbg, dbg.step_out());
+		} else if (strcmp(command, "c") == 0) {
+			print_stop(dbg, dbg.run(count > 1 ? strtoull(args[1], nullptr, 10) : 10000000ull));
+		} else if (strcmp(command, "r") == 0) {
+			print_registers(*emulator);
+		} else if (strcmp(command, "bt") == 0) {
+			uint16_t frames[16];
+			size_t depth = dbg.call_stack(frames, 16);
+			printf("#0 %03X\n", emulator->program_counter());
+			for (size_t i = 0; i < depth; ++i) {
+				printf("#%zu %03X\n", i + 1, frames[i]);
+			}
+		} else if (strcmp(command, "x") == 0 && count > 1) {
+			print_memory(*emulator, arg1, count > 2 ? arg2 : 16);
+		} else if (strcmp(command, "keys") == 0 && count > 1) {
+			emulator->set_keys((uint16_t) arg1);
+		} else {
+			printf("Unknown command, type 'h' for help\n");
+		}
+	}
+	//endregion
+
+	return 0;
+}
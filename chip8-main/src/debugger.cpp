@@ -0,0 +1,188 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include "debugger.hpp"
+
+namespace chip8 {
+	namespace debug {
+		// Upper bound for step_over/step_out when a subroutine never returns
+		constexpr uint64_t step_limit = 10000000;
+
+		void debugger::watch(uint16_t address, uint16_t length) noexcept {
+			for (uint32_t i = 0; i < length; ++i) {
+				if (!test_bit(watchpoints, address + i)) {
+					set_bit(watchpoints, address + i);
+					++watch_count;
+				}
+			}
+		}
+
+		void debugger::unwatch(uint16_t address, uint16_t length) noexcept {
+			for (uint32_t i = 0; i < length; ++i) {
+				if (test_bit(watchpoints, address + i)) {
+					clear_bit(watchpoints, address + i);
+					--watch_count;
+				}
+			}
+		}
+
+		bool debugger::add_condition(const condition &cond) noexcept {
+			if (condition_count == max_conditions || (cond.what > target::VF && cond.what != target::I)) {
+				return false;
+			}
+
+			conditions[condition_count] = cond;
+			previous[condition_count] = read_target(cond.what);
+			// A condition that already holds waits until it becomes true again
+			was_met[condition_count] = evaluate(cond, previous[condition_count], previous[condition_count]);
+			++condition_count;
+			return true;
+		}
+
+		stop_reason debugger::step_in() noexcept {
+			stop_reason reason = run(1);
+			return reason == stop_reason::cycle_limit ? stop_reason::step : reason;
+		}
+
+		stop_reason debugger::step_over() noexcept {
+			uint16_t opcode = c.ram()[c.program_counter() & 0xFFFu] << 8u | c.ram()[(c.program_counter() + 1) & 0xFFFu];
+			if ((opcode & 0xF000u) != 0x2000u) {
+				return step_in();
+			}
+
+			uint16_t return_to = c.program_counter() + 2;
+			uint16_t depth = c.stack_pointer();
+			stop_reason reason;
+			if (!execute(false, reason)) {
+				return reason;
+			}
+			for (uint64_t i = 0; c.program_counter() != return_to || c.stack_pointer() != depth; ++i) {
+				if (i == step_limit) {
+					return stop_reason::cycle_limit;
+				}
+				if (!execute(true, reason)) {
+					return reason;
+				}
+			}
+			return stop_reason::step;
+		}
+
+		stop_reason debugger::step_out() noexcept {
+			if (c.stack_pointer() == 0) {
+				return step_in();
+			}
+
+			uint16_t depth = c.stack_pointer();
+			stop_reason reason;
+			for (uint64_t i = 0; c.stack_pointer() >= depth; ++i) {
+				if (i == step_limit) {
+					return stop_reason::cycle_limit;
+				}
+				if (!execute(i != 0, reason)) {
+					return reason;
+				}
+			}
+			return stop_reason::step;
+		}
+
+		stop_reason debugger::run(uint64_t max_cycles) noexcept {
+			stop_reason reason;
+			for (uint64_t i = 0; i < max_cycles; ++i) {
+				if (!execute(i != 0, reason)) {
+					return reason;
+				}
+			}
+			return stop_reason::cycle_limit;
+		}
+
+		size_t debugger::call_stack(uint16_t *frames, size_t max_frames) const noexcept {
+			size_t depth = c.stack_pointer() < chip8::stack_depth ? c.stack_pointer() : chip8::stack_depth;
+			size_t count = 0;
+			while (count < depth && count < max_frames) {
+				frames[count] = c.call_stack()[depth - 1 - count];
+				++count;
+			}
+			return count;
+		}
+
+		bool debugger::execute(bool check_pc, stop_reason &reason) noexcept {
+			if (check_pc && test_bit(breakpoints, c.program_counter())) {
+				reason = stop_reason::breakpoint;
+				return false;
+			}
+
+			// Decoded before the instruction runs (FX55 moves I), reported after it has,
+			// so the first instruction after a resume is checked like any other
+			bool watched = watch_count != 0 && !c.waiting_for_key() && writes_watched_memory();
+
+			c.cycle();
+			++executed;
+
+			bool met = condition_count != 0 && condition_met();
+			if (watched) {
+				reason = stop_reason::watchpoint;
+				return false;
+			}
+			if (met) {
+				reason = stop_reason::condition;
+				return false;
+			}
+			return true;
+		}
+
+		uint16_t debugger::read_target(target what) const noexcept {
+			if (what == target::I) {
+				return c.index_register();
+			}
+			return c.registers()[(unsigned char) what & 0xFu];
+		}
+
+		bool debugger::writes_watched_memory() noexcept {
+			uint16_t opcode = c.ram()[c.program_counter() & 0xFFFu] << 8u | c.ram()[(c.program_counter() + 1) & 0xFFFu];
+
+			uint16_t length;
+			if ((opcode & 0xF0FFu) == 0xF033u) {
+				length = 3;
+			} else if ((opcode & 0xF0FFu) == 0xF055u) {
+				length = ((opcode & 0x0F00u) >> 8u) + 1;
+			} else {
+				return false;
+			}
+
+			for (uint16_t i = 0; i < length; ++i) {
+				if (test_bit(watchpoints, c.index_register() + i)) {
+					watch_hit = (c.index_register() + i) & (address_space - 1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool debugger::evaluate(const condition &cond, uint16_t value, uint16_t before) noexcept {
+			switch (cond.how) {
+				case compare::equal: return value == cond.value;
+				case compare::not_equal: return value != cond.value;
+				case compare::changed: return value != before;
+				default: return false;
+			}
+		}
+
+		bool debugger::condition_met() noexcept {
+			bool met = false;
+			for (size_t i = 0; i < condition_count; ++i) {
+				uint16_t value = read_target(conditions[i].what);
+
+				// == and != fire on the instruction that makes them true, not while they hold
+				bool holds = evaluate(conditions[i], value, previous[i]);
+				bool hit = conditions[i].how == compare::changed ? holds : holds && !was_met[i];
+				was_met[i] = holds;
+				previous[i] = value;
+
+				if (hit && !met) {
+					condition_hit = i;
+					met = true;
+				}
+			}
+			return met;
+		}
+	}
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_DEBUGGER
+#define CHIP8_DEBUGGER
+
+#include <cstddef>
+#include <cstdint>
+
+#include "chip8.hpp"
+
+// Debugging layer around chip8::cycle().
+// Production runs call cycle() directly and pay nothing; under the debugger a
+// breakpoint check is one bitmap test per instruction, and watchpoints and
+// register conditions are only evaluated while any are set.
+namespace chip8 {
+	namespace debug {
+		enum class stop_reason {
+			step,           // Requested number of instructions executed
+			breakpoint,     // PC hit a breakpoint; the instruction has not run
+			watchpoint,     // The last instruction (FX33/FX55) wrote watched memory
+			condition,      // A register condition became true after the last instruction
+			cycle_limit,    // run() exhausted its budget
+		};
+
+		enum class target : unsigned char {
+			V0 = 0x0, VF = 0xF,
+			I = 0x10,
+		};
+
+		enum class compare : unsigned char {
+			equal,
+			not_equal,
+			changed,
+		};
+
+		struct condition {
+			target what;
+			compare how;
+			uint16_t value;     // Ignored for `changed`
+		};
+
+		class debugger {
+		public:
+			static constexpr size_t max_conditions = 8;
+			static constexpr size_t address_space = chip8::memory_size;
+
+			explicit debugger(chip8 &emulator) noexcept : c(emulator) {}
+
+			//region Breakpoints and watchpoints
+			void set_breakpoint(uint16_t address) noexcept { set_bit(breakpoints, address); }
+			void clear_breakpoint(uint16_t address) noexcept { clear_bit(breakpoints, address); }
+			bool has_breakpoint(uint16_t address) const noexcept { return test_bit(breakpoints, address); }
+
+			void watch(uint16_t address, uint16_t length = 1) noexcept;
+			void unwatch(uint16_t address, uint16_t length = 1) noexcept;
+
+			bool add_condition(const condition &cond) noexcept;
+			void clear_conditions() noexcept { condition_count = 0; }
+			//endregion
+			//region Execution
+			stop_reason step_in() noexcept;
+			// Executes a 2NNN call as a single step.
+			stop_reason step_over() noexcept;
+			// Runs until the current subroutine returns.
+			stop_reason step_out() noexcept;
+			// Executes up to `max_cycles` instructions, stopping early on a breakpoint,
+			// watchpoint or condition. A breakpoint at the current PC is ignored so
+			// continuing from it makes progress; watchpoints and conditions are
+			// checked on every instruction, the first included.
+			stop_reason run(uint64_t max_cycles) noexcept;
+			//endregion
+			//region Inspection
+			// Return addresses, innermost first. Returns the number written.
+			size_t call_stack(uint16_t *frames, size_t max_frames) const noexcept;
+			// Memory address that triggered the last watchpoint stop.
+			uint16_t watch_address() const noexcept { return watch_hit; }
+			// Index of the condition that triggered the last condition stop.
+			size_t condition_index() const noexcept { return condition_hit; }
+			uint64_t cycles() const noexcept { return executed; }
+			//endregion
+
+		private:
+			using bitmap = uint64_t[address_space / 64];
+
+			static bool test_bit(const bitmap &map, uint16_t address) noexcept {
+				address &= address_space - 1;
+				return (map[address >> 6u] >> (address & 63u)) & 0x1u;
+			}
+			static void set_bit(bitmap &map, uint16_t address) noexcept {
+				address &= address_space - 1;
+				map[address >> 6u] |= uint64_t{1} << (address & 63u);
+			}
+			static void clear_bit(bitmap &map, uint16_t address) noexcept {
+				address &= address_space - 1;
+				map[address >> 6u] &= ~(uint64_t{1} << (address & 63u));
+			}
+
+			// Runs one instruction. Returns false, with the reason, if execution should stop.
+			// `check_pc` enables the breakpoint test before the instruction.
+			bool execute(bool check_pc, stop_reason &reason) noexcept;
+			uint16_t read_target(target what) const noexcept;
+			bool writes_watched_memory() noexcept;
+			bool condition_met() noexcept;
+			static bool evaluate(const condition &cond, uint16_t value, uint16_t before) noexcept;
+
+			chip8 &c;
+
+			bitmap breakpoints = {};
+			bitmap watchpoints = {};
+			size_t watch_count = 0;
+
+			condition conditions[max_conditions] = {};
+			uint16_t previous[max_conditions] = {};
+			bool was_met[max_conditions] = {};   // Result after the previous instruction
+			size_t condition_count = 0;
+
+			uint16_t watch_hit = 0;
+			size_t condition_hit = 0;
+			uint64_t executed = 0;
+		};
+	}
+}
+
+#endif //CHIP8_DEBUGGER
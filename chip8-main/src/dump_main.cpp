@@ -0,0 +1,200 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "frame_ring.hpp"
+
+//region Run control
+volatile sig_atomic_t running = 1;
+//endregion
+
+void stop_running(int) {
+	running = 0;
+}
+
+//region PNG
+// Minimal encoder: 1-bit grayscale, one stored (uncompressed) deflate block.
+// The packed frame layout already matches PNG's 1bpp scanline format.
+uint32_t crc_table[256];
+
+void init_crc_table() {
+	for (uint32_t n = 0; n < 256; ++n) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; ++k) {
+			c = (c & 1u) ? 0xEDB88320u ^ (c >> 1u) : c >> 1u;
+		}
+		crc_table[n] = c;
+	}
+}
+
+uint32_t crc(uint32_t c, const unsigned char *data, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		c = crc_table[(c ^ data[i]) & 0xFFu] ^ (c >> 8u);
+	}
+	return c;
+}
+
+void put_u32(unsigned char *out, uint32_t value) {
+	out[0] = value >> 24u;
+	out[1] = value >> 16u;
+	out[2] = value >> 8u;
+	out[3] = value;
+}
+
+void write_chunk(FILE *file, const char *type, const unsigned char *data, uint32_t size) {
+	unsigned char word[4];
+	put_u32(word, size);
+	fwrite(word, 1, 4, file);
+	fwrite(type, 1, 4, file);
+	if (size != 0) {
+		fwrite(data, 1, size, file);
+	}
+
+	uint32_t c = crc(0xFFFFFFFFu, (const unsigned char *) type, 4);
+	c = crc(c, data, size) ^ 0xFFFFFFFFu;
+	put_u32(word, c);
+	fwrite(word, 1, 4, file);
+}
+
+bool write_png(const char *filename, const unsigned char *packed) {
+	constexpr uint32_t row_bytes = DISPLAY_WIDTH / 8;
+	constexpr uint32_t raw_bytes = (row_bytes + 1) * DISPLAY_HEIGHT;
+
+	FILE *file = fopen(filename, "wb");
+	if (file == nullptr) {
+		fprintf(stderr, "cannot open file '%s': %s\n", filename, strerror(errno));
+		return false;
+	}
+
+	static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	fwrite(signature, 1, sizeof(signature), file);
+
+	unsigned char ihdr[13] = {};
+	put_u32(ihdr, DISPLAY_WIDTH);
+	put_u32(ihdr + 4, DISPLAY_HEIGHT);
+	ihdr[8] = 1;   // Bit depth
+	ihdr[9] = 0;   // Grayscale
+	write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+	// zlib header, stored block header, scanlines, adler32
+	unsigned char idat[2 + 5 + raw_bytes + 4];
+	unsigned char *raw = idat + 7;
+	idat[0] = 0x78;
+	idat[1] = 0x01;
+	idat[2] = 0x01;
+	idat[3] = raw_bytes & 0xFFu;
+	idat[4] = raw_bytes >> 8u;
+	idat[5] = ~raw_bytes & 0xFFu;
+	idat[6] = (~raw_bytes >> 8u) & 0xFFu;
+	for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y) {
+		raw[y * (row_bytes + 1)] = 0;  // Filter: none
+		memcpy(raw + y * (row_bytes + 1) + 1, packed + y * row_bytes, row_bytes);
+	}
+	uint32_t a = 1, b = 0;
+	for (uint32_t i = 0; i < raw_bytes; ++i) {
+		a = (a + raw[i]) % 65521u;
+		b = (b + a) % 65521u;
+	}
+	put_u32(raw + raw_bytes, (b << 16u) | a);
+	write_chunk(file, "IDAT", idat, sizeof(idat));
+	write_chunk(file, "IEND", nullptr, 0);
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+//endregion
+
+int main(int argc, char **argv) {
+	//region Setup
+	if (argc < 3) {
+		printf("Usage: chip8-dump <instance_id> <output> [--png] [--frames N]\n"
+		       "  raw:  <output> receives 8-bit gray 64x32 frames (ffmpeg -f rawvideo -pix_fmt gray -s 64x32)\n"
+		       "  png:  <output> is a prefix, frames are written as <output>_000001.png, ...\n\n");
+		return 65;
+	}
+
+	auto instance_id = (uint32_t) strtoul(argv[1], nullptr, 10);
+	const char *output = argv[2];
+	bool png = false;
+	unsigned long long limit = 0;
+	for (int i = 3; i < argc; ++i) {
+		if (strcmp(argv[i], "--png") == 0) {
+			png = true;
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			limit = strtoull(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 65;
+		}
+	}
+
+	chip8::frames::source source;
+	if (!source.open(instance_id)) {
+		return 1;
+	}
+
+	FILE *raw = nullptr;
+	if (png) {
+		init_crc_table();
+	} else if ((raw = fopen(output, "wb")) == nullptr) {
+		fprintf(stderr, "cannot open file '%s': %s\n", output, strerror(errno));
+		return 1;
+	}
+
+	signal(SIGINT, stop_running);
+	signal(SIGTERM, stop_running);
+	//endregion
+
+	//region Capture loop
+	unsigned char packed[chip8::frames::frame_bytes];
+	unsigned char gray[DISPLAY_SIZE];
+	unsigned long long written = 0, dropped = 0;
+	uint64_t next = source.latest() + 1;
+	while (running && (limit == 0 || written < limit)) {
+		uint64_t latest = source.latest();
+		if (latest < next) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		// Fell behind by more than the ring holds: skip ahead
+		if (latest - next >= source.slot_count()) {
+			dropped += latest - next - source.slot_count() + 1;
+			next = latest - source.slot_count() + 1;
+		}
+		if (!source.read(next, packed)) {
+			++dropped;
+			++next;
+			continue;
+		}
+
+		if (png) {
+			char filename[4096];
+			snprintf(filename, sizeof(filename), "%s_%06llu.png", output, (unsigned long long) next);
+			if (!write_png(filename, packed)) {
+				return 1;
+			}
+		} else {
+			for (unsigned int i = 0; i < DISPLAY_SIZE; ++i) {
+				gray[i] = ((packed[i / 8] >> (7u - i % 8u)) & 1u) ? 0xFF : 0x00;
+			}
+			fwrite(gray, 1, sizeof(gray), raw);
+		}
+		++written;
+		++next;
+	}
+	//endregion
+
+	if (raw != nullptr) {
+		fclose(raw);
+	}
+	printf("Wrote %llu frames, dropped %llu\n", written, dropped);
+	return 0;
+}
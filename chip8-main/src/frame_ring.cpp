@@ -0,0 +1,147 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "frame_ring.hpp"
+
+namespace chip8 {
+	namespace frames {
+		void pack(const unsigned char *gfx, unsigned char *packed) noexcept {
+			for (uint32_t i = 0; i < frame_bytes; ++i) {
+				const unsigned char *p = gfx + i * 8;
+				packed[i] = (unsigned char) ((p[0] & 1u) << 7u | (p[1] & 1u) << 6u | (p[2] & 1u) << 5u |
+				                             (p[3] & 1u) << 4u | (p[4] & 1u) << 3u | (p[5] & 1u) << 2u |
+				                             (p[6] & 1u) << 1u | (p[7] & 1u));
+			}
+		}
+
+		void ring_name(uint32_t instance_id, char *name, size_t size) noexcept {
+			snprintf(name, size, "/chip8-frames-%u", instance_id);
+		}
+
+		//region Sink
+		sink::~sink() {
+			if (ring != nullptr) {
+				munmap(ring, mapped_bytes);
+				shm_unlink(name);
+			}
+		}
+
+		bool sink::open(uint32_t instance_id, uint32_t slot_count) {
+			ring_name(instance_id, name, sizeof(name));
+			mapped_bytes = sizeof(ring_header) + slot_count * sizeof(ring_slot);
+
+			int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+			if (fd < 0) {
+				fprintf(stderr, "cannot create frame ring '%s': %s\n", name, strerror(errno));
+				return false;
+			}
+			if (ftruncate(fd, mapped_bytes) != 0) {
+				fprintf(stderr, "cannot size frame ring: %s\n", strerror(errno));
+				close(fd);
+				return false;
+			}
+			void *region = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (region == MAP_FAILED) {
+				fprintf(stderr, "cannot map frame ring: %s\n", strerror(errno));
+				return false;
+			}
+
+			// Fresh mappings are zero-filled, so slots start out as "never written"
+			ring = static_cast<ring_header *>(region);
+			slots = reinterpret_cast<ring_slot *>(ring + 1);
+			ring->instance_id = instance_id;
+			ring->slot_count = slot_count;
+			ring->width = DISPLAY_WIDTH;
+			ring->height = DISPLAY_HEIGHT;
+			ring->frame_bytes = frame_bytes;
+			ring->version = version;
+			ring->head.store(0, std::memory_order_relaxed);
+			// Readers check magic last
+			std::atomic_thread_fence(std::memory_order_release);
+			ring->magic = magic;
+			return true;
+		}
+
+		void sink::publish(const chip8 &c) noexcept {
+			++sequence;
+			ring_slot &slot = slots[sequence % ring->slot_count];
+
+			slot.sequence.store(sequence * 2 - 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			pack(c.framebuffer(), slot.pixels);
+			slot.sequence.store(sequence * 2, std::memory_order_release);
+			ring->head.store(sequence, std::memory_order_release);
+		}
+		//endregion
+		//region Source
+		source::~source() {
+			if (ring != nullptr) {
+				munmap(const_cast<ring_header *>(ring), mapped_bytes);
+			}
+		}
+
+		bool source::open(uint32_t instance_id) {
+			char name[64];
+			ring_name(instance_id, name, sizeof(name));
+
+			int fd = shm_open(name, O_RDONLY, 0);
+			if (fd < 0) {
+				fprintf(stderr, "cannot open frame ring '%s': %s\n", name, strerror(errno));
+				return false;
+			}
+
+			// Map the header first to learn the ring size
+			void *region = mmap(nullptr, sizeof(ring_header), PROT_READ, MAP_SHARED, fd, 0);
+			if (region == MAP_FAILED) {
+				fprintf(stderr, "cannot map frame ring: %s\n", strerror(errno));
+				close(fd);
+				return false;
+			}
+			auto *header = static_cast<const ring_header *>(region);
+			bool valid = header->magic == magic && header->version == version && header->frame_bytes == frame_bytes;
+			uint32_t slot_count = header->slot_count;
+			munmap(region, sizeof(ring_header));
+			if (!valid || slot_count == 0) {
+				fprintf(stderr, "frame ring '%s' is not ready or has an unknown format\n", name);
+				close(fd);
+				return false;
+			}
+
+			mapped_bytes = sizeof(ring_header) + slot_count * sizeof(ring_slot);
+			region = mmap(nullptr, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			if (region == MAP_FAILED) {
+				fprintf(stderr, "cannot map frame ring: %s\n", strerror(errno));
+				return false;
+			}
+			ring = static_cast<const ring_header *>(region);
+			slots = reinterpret_cast<const ring_slot *>(ring + 1);
+			return true;
+		}
+
+		uint64_t source::latest() const noexcept { return ring->head.load(std::memory_order_acquire); }
+
+		bool source::read(uint64_t seq, unsigned char *packed) const noexcept {
+			if (seq == 0) {
+				return false;
+			}
+
+			const ring_slot &slot = slots[seq % ring->slot_count];
+			if (slot.sequence.load(std::memory_order_acquire) != seq * 2) {
+				return false;
+			}
+			memcpy(packed, slot.pixels, frame_bytes);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return slot.sequence.load(std::memory_order_relaxed) == seq * 2;
+		}
+		//endregion
+	}
+}
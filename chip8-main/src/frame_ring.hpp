@@ -0,0 +1,95 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_FRAME_RING
+#define CHIP8_FRAME_RING
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "chip8.hpp"
+
+// Shared-memory ring of completed frames, one ring per emulator instance.
+// Frames are packed 1bpp, row-major, most significant bit = leftmost pixel.
+// The writer never waits for readers: every slot carries a sequence number
+// (odd while being written) and readers simply retry or skip torn frames.
+namespace chip8 {
+	namespace frames {
+		constexpr uint32_t magic = 0x38504843; // "CHP8"
+		constexpr uint32_t version = 1;
+		constexpr uint32_t frame_bytes = DISPLAY_SIZE / 8;
+		constexpr uint32_t default_slots = 64;
+
+		struct alignas(64) ring_header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t instance_id;
+			uint32_t slot_count;
+			uint32_t width;
+			uint32_t height;
+			uint32_t frame_bytes;
+			std::atomic<uint64_t> head;        // Sequence of the newest published frame, 0 = none
+		};
+
+		struct alignas(64) ring_slot {
+			std::atomic<uint64_t> sequence;    // 2 * frame sequence when stable, odd while writing
+			unsigned char pixels[frame_bytes];
+		};
+
+		static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring needs lock-free sequence counters");
+
+		// Packs a one-byte-per-pixel framebuffer into 1bpp.
+		void pack(const unsigned char *gfx, unsigned char *packed) noexcept;
+
+		// Publishes frames of one instance. Owns (and unlinks) the shared-memory object.
+		class sink {
+		public:
+			sink() = default;
+			~sink();
+
+			sink(const sink &) = delete;
+			sink &operator=(const sink &) = delete;
+
+			bool open(uint32_t instance_id, uint32_t slot_count = default_slots);
+			void publish(const chip8 &c) noexcept;
+
+			uint64_t published() const noexcept { return sequence; }
+
+		private:
+			ring_header *ring = nullptr;
+			ring_slot *slots = nullptr;
+			size_t mapped_bytes = 0;
+			uint64_t sequence = 0;
+			char name[64] = {};
+		};
+
+		// Read-only view of another process' ring.
+		class source {
+		public:
+			source() = default;
+			~source();
+
+			source(const source &) = delete;
+			source &operator=(const source &) = delete;
+
+			bool open(uint32_t instance_id);
+
+			// Sequence of the newest published frame, 0 if none yet.
+			uint64_t latest() const noexcept;
+			// Copies frame `seq` into `packed` (frame_bytes long).
+			// Fails if the frame was overwritten or is being written.
+			bool read(uint64_t seq, unsigned char *packed) const noexcept;
+			uint32_t slot_count() const noexcept { return ring->slot_count; }
+
+		private:
+			const ring_header *ring = nullptr;
+			const ring_slot *slots = nullptr;
+			size_t mapped_bytes = 0;
+		};
+
+		// Shared-memory object name for an instance, e.g. "/chip8-frames-7".
+		void ring_name(uint32_t instance_id, char *name, size_t size) noexcept;
+	}
+}
+
+#endif //CHIP8_FRAME_RING
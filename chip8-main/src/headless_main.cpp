@@ -0,0 +1,355 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "chip8.hpp"
+#include "frame_ring.hpp"
+#include "pool.hpp"
+#include "trace.hpp"
+#include "wall.hpp"
+
+//region Run control
+volatile sig_atomic_t running = 1;
+
+// Frame period in emulated cycles: a 600 instructions/s CHIP-8 shown at 60 Hz.
+// Draws within one period are published as a single frame.
+constexpr unsigned long cycles_per_frame = 10;
+//endregion
+
+void stop_running(int) {
+	running = 0;
+}
+
+//region L1 miss counter
+// L1 data-cache read misses of this thread, for checking the chip8 state layout.
+// Returns -1 (errno set) where perf events or the cache counters are unavailable.
+int open_l1_counter() {
+#ifdef __linux__
+	perf_event_attr attr{};
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8u) |
+	              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16u);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void enable_l1_counter(int fd) {
+#ifdef __linux__
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+bool read_l1_counter(int fd, unsigned long long &misses) {
+#ifdef __linux__
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	uint64_t value;
+	bool ok = read(fd, &value, sizeof(value)) == sizeof(value);
+	close(fd);
+	misses = value;
+	return ok;
+#else
+	return false;
+#endif
+}
+//endregion
+
+//region Allocation counter
+// Global operator new is replaced for the whole binary so --pool-churn can
+// check that pool round trips never reach the heap.
+std::atomic<unsigned long long> heap_allocations{0};
+
+void *counted_allocation(size_t size) {
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(size != 0 ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *counted_allocation(size_t size, std::align_val_t alignment) {
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	auto align = (size_t) alignment;
+	// aligned_alloc wants a size that is a multiple of the alignment
+	void *p = aligned_alloc(align, (size + align - 1) / align * align);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new(size_t size) { return counted_allocation(size); }
+void *operator new[](size_t size) { return counted_allocation(size); }
+void *operator new(size_t size, std::align_val_t alignment) { return counted_allocation(size, alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return counted_allocation(size, alignment); }
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { free(p); }
+//endregion
+
+//region Pool churn
+// Instances kept alive at once during --pool-churn, and cycles run per round trip
+constexpr size_t churn_capacity = 8;
+constexpr unsigned long churn_cycles = 1000;
+
+// create(rom) / cycle / destroy round trips against a chip8::pool, reporting how many
+// heap allocations they caused. Returns false if any did.
+bool pool_churn(const chip8::chip8 &loaded, unsigned long long rounds) {
+	chip8::pool slots(churn_capacity);
+	// The ROM exactly as load_game placed it
+	const unsigned char *rom = loaded.ram() + chip8::chip8::program_start;
+	size_t rom_size = chip8::chip8::memory_size - chip8::chip8::program_start;
+
+	chip8::chip8 *live[churn_capacity] = {};
+	unsigned long long before = heap_allocations.load(std::memory_order_relaxed);
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned long long n = 0; n < rounds; ++n) {
+		// Recycle the oldest slot so the free list is exercised, not just one slot
+		chip8::chip8 *&c = live[n % churn_capacity];
+		if (c != nullptr) {
+			slots.destroy(c);
+		}
+		c = slots.create(rom, rom_size);
+		if (c == nullptr) {
+			fprintf(stderr, "Pool of %zu instances could not create one\n", churn_capacity);
+			return false;
+		}
+		for (unsigned long i = 0; i < churn_cycles; ++i) {
+			c->cycle();
+		}
+	}
+	for (chip8::chip8 *c : live) {
+		if (c != nullptr) {
+			slots.destroy(c);
+		}
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	unsigned long long allocations = heap_allocations.load(std::memory_order_relaxed) - before;
+
+	printf("Pool churn: %llu create/cycle/destroy round trips in %.3f s (%s), %llu heap allocations\n",
+	       rounds, elapsed.count(), slots.huge_pages() ? "huge pages" : "regular pages", allocations);
+	return allocations == 0;
+}
+//endregion
+
+// Binary PPM of a software-rastered wall (0xAARRGGBB texels)
+bool write_ppm(const char *filename, const uint32_t *pixels, unsigned int width, unsigned int height) {
+	FILE *file = fopen(filename, "wb");
+	if (file == nullptr) {
+		fprintf(stderr, "cannot open file '%s': %s\n", filename, strerror(errno));
+		return false;
+	}
+
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	std::vector<unsigned char> row(width * 3);
+	for (unsigned int y = 0; y < height; ++y) {
+		for (unsigned int x = 0; x < width; ++x) {
+			uint32_t texel = pixels[y * width + x];
+			row[x * 3 + 0] = (unsigned char) (texel >> 16u);
+			row[x * 3 + 1] = (unsigned char) (texel >> 8u);
+			row[x * 3 + 2] = (unsigned char) texel;
+		}
+		fwrite(row.data(), 1, row.size(), file);
+	}
+
+	bool ok = ferror(file) == 0;
+	ok = fclose(file) == 0 && ok;
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	//region Setup
+	if (argc < 2) {
+		printf("Usage: chip8-headless <game_filename> [--cycles N] [--seed N] [--publish instance_id]\n"
+		       "                      [--trace file] [--trace-raw] [--wall N] [--wall-out file.ppm]\n"
+		       "                      [--l1-misses] [--pool-churn N]\n\n");
+		return 65;
+	}
+
+	unsigned long long cycles = 0;  // 0 = until interrupted
+	unsigned long long seed = 0;
+	bool publish = false;
+	unsigned long instance_id = 0;
+	const char *trace_file = nullptr;
+	bool trace_compress = true;
+	unsigned long wall_count = 1;
+	const char *wall_out = nullptr;
+	bool count_l1 = false;
+	unsigned long long churn_rounds = 0;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+			cycles = strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--publish") == 0 && i + 1 < argc) {
+			publish = true;
+			instance_id = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace_file = argv[++i];
+		} else if (strcmp(argv[i], "--trace-raw") == 0) {
+			trace_compress = false;
+		} else if (strcmp(argv[i], "--wall") == 0 && i + 1 < argc) {
+			wall_count = strtoul(argv[++i], nullptr, 10);
+			if (wall_count == 0) {
+				fprintf(stderr, "--wall needs at least one instance\n");
+				return 65;
+			}
+		} else if (strcmp(argv[i], "--l1-misses") == 0) {
+			count_l1 = true;
+		} else if (strcmp(argv[i], "--pool-churn") == 0 && i + 1 < argc) {
+			churn_rounds = strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--wall-out") == 0 && i + 1 < argc) {
+			wall_out = argv[++i];
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 65;
+		}
+	}
+
+	static chip8::chip8 emulator{};
+	emulator.seed(seed);
+	if (!emulator.load_game(argv[1])) {
+		return 1;
+	}
+	if (churn_rounds != 0) {
+		return pool_churn(emulator, churn_rounds) ? 0 : 1;
+	}
+
+	// Wall instances run the same ROM with seeds seed+1, seed+2, ...; publishing
+	// and tracing follow the first instance only
+	std::vector<chip8::chip8 *> instances{&emulator};
+	std::unique_ptr<chip8::pool> wall_pool;
+	if (wall_count > 1) {
+		wall_pool.reset(new chip8::pool(wall_count - 1));
+		for (unsigned long i = 1; i < wall_count; ++i) {
+			chip8::chip8 *c = wall_pool->create();
+			if (c == nullptr) {
+				fprintf(stderr, "Cannot allocate %lu instances\n", wall_count);
+				return 1;
+			}
+			*c = emulator;
+			c->seed(seed + i);
+			instances.push_back(c);
+		}
+	}
+
+	static chip8::frames::sink sink;
+	if (publish && !sink.open((uint32_t) instance_id)) {
+		return 1;
+	}
+
+	static chip8::trace::writer trace;
+	if (trace_file != nullptr && !trace.open(trace_file, trace_compress)) {
+		return 1;
+	}
+
+	signal(SIGINT, stop_running);
+	signal(SIGTERM, stop_running);
+	//endregion
+
+	int l1_counter = -1;
+	if (count_l1) {
+		l1_counter = open_l1_counter();
+		if (l1_counter < 0) {
+			fprintf(stderr, "L1 miss counter unavailable: %s\n", strerror(errno));
+		} else {
+			enable_l1_counter(l1_counter);
+		}
+	}
+
+	//region Main loop
+	auto start = std::chrono::steady_clock::now();
+	unsigned long long executed = 0;
+	unsigned long frame_cycles = 0;
+	bool frame_dirty = false;
+	while (running && (cycles == 0 || executed < cycles)) {
+		if (trace_file != nullptr) {
+			trace.step(emulator);
+		} else {
+			emulator.cycle();
+		}
+		for (size_t i = 1; i < instances.size(); ++i) {
+			instances[i]->cycle();
+		}
+		++executed;
+
+		if (emulator.draw_pending()) {
+			frame_dirty = true;
+			emulator.clear_draw();
+		}
+		if (++frame_cycles == cycles_per_frame) {
+			if (frame_dirty && publish) {
+				sink.publish(emulator);
+			}
+			frame_dirty = false;
+			frame_cycles = 0;
+		}
+	}
+	// Flush a partial last frame so readers see the final screen
+	if (frame_dirty && publish) {
+		sink.publish(emulator);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	//endregion
+
+	unsigned long long l1_misses = 0;
+	bool l1_counted = l1_counter >= 0 && read_l1_counter(l1_counter, l1_misses);
+
+	unsigned long long total = executed * instances.size();
+	printf("Executed %llu cycles in %.3f s (%.0f IPS)\n", total, elapsed.count(),
+	       elapsed.count() > 0 ? total / elapsed.count() : 0.0);
+	if (l1_counted) {
+		printf("L1D read misses: %llu (%.4f per instruction)\n", l1_misses,
+		       total > 0 ? (double) l1_misses / total : 0.0);
+	}
+	if (trace_file != nullptr) {
+		if (!trace.close()) {
+			fprintf(stderr, "Failed to write trace '%s'\n", trace_file);
+			return 1;
+		}
+		printf("Traced %llu records to %s\n", (unsigned long long) trace.records(), trace_file);
+	}
+	if (wall_out != nullptr) {
+		chip8::wall::layout grid = chip8::wall::arrange(instances.size());
+		std::vector<uint32_t> pixels((size_t) grid.width() * grid.height());
+		chip8::wall::raster(instances.data(), instances.size(), grid, pixels.data());
+		if (!write_ppm(wall_out, pixels.data(), grid.width(), grid.height())) {
+			return 1;
+		}
+		printf("Wrote %ux%u wall of %zu instances to %s\n", grid.columns, grid.rows, instances.size(), wall_out);
+	}
+	if (publish) {
+		printf("Published %llu frames\n", (unsigned long long) sink.published());
+	}
+	return 0;
+}
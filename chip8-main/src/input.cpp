@@ -0,0 +1,81 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cctype>
+#include <cstring>
+
+#include <GLFW/glfw3.h>
+
+#include "input.hpp"
+
+namespace chip8 {
+	namespace input {
+		// CHIP-8 key at each position of the on-screen keypad
+		constexpr unsigned char keypad_order[16] = {
+				0x1, 0x2, 0x3, 0xC,
+				0x4, 0x5, 0x6, 0xD,
+				0x7, 0x8, 0x9, 0xE,
+				0xA, 0x0, 0xB, 0xF,
+		};
+
+		// GLFW key codes for letters and digits equal their upper-case ASCII values
+		static_assert(GLFW_KEY_A == 'A' && GLFW_KEY_Z == 'Z' && GLFW_KEY_0 == '0' && GLFW_KEY_9 == '9',
+		              "keymap relies on GLFW's ASCII key codes");
+
+		keymap::keymap() {
+			parse("1234QWERASDFZXCV");
+		}
+
+		bool keymap::parse(const char *layout) noexcept {
+			if (layout == nullptr || strlen(layout) != 16) {
+				return false;
+			}
+
+			signed char parsed[table_size];
+			memset(parsed, -1, sizeof(parsed));
+			for (int i = 0; i < 16; ++i) {
+				int host_key = toupper((unsigned char) layout[i]);
+				if (!isalnum(host_key) || parsed[host_key] != -1) {
+					return false;
+				}
+				parsed[host_key] = (signed char) keypad_order[i];
+			}
+
+			memcpy(table, parsed, sizeof(table));
+			return true;
+		}
+
+		void queue::push(const event &e) noexcept {
+			// On overflow drop the oldest event rather than the newest
+			if (tail - head == capacity) {
+				++head;
+			}
+			events[tail++ & (capacity - 1)] = e;
+		}
+
+		void queue::apply(chip8 &c) noexcept {
+			uint16_t pressed = 0;
+			while (head != tail) {
+				const event &e = events[head++ & (capacity - 1)];
+				uint16_t bit = 1u << e.key;
+
+				if (e.pressed) {
+					c.key_down(e.key);
+					pressed |= bit;
+					deferred &= ~bit;
+				} else if (pressed & bit) {
+					deferred |= bit;
+				} else {
+					c.key_up(e.key);
+				}
+				last_time = e.time;
+			}
+		}
+
+		void queue::release_deferred(chip8 &c) noexcept {
+			if (deferred != 0) {
+				c.set_keys(c.key_mask() & ~deferred);
+				deferred = 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_INPUT
+#define CHIP8_INPUT
+
+#include <cstdint>
+
+#include "chip8.hpp"
+
+// Event-driven keypad input for the windowed front end.
+// GLFW key callbacks push timestamped events; the main loop applies them to
+// the emulator right before each cycle, so presses shorter than a frame are
+// still seen by the ROM.
+namespace chip8 {
+	namespace input {
+		struct event {
+			double time;            // glfwGetTime() at the callback
+			unsigned char key;      // CHIP-8 key 0x0 - 0xF
+			bool pressed;
+		};
+
+		// Host key -> CHIP-8 key table.
+		class keymap {
+		public:
+			// 1234 / QWER / ASDF / ZXCV
+			keymap();
+
+			// Parses 16 characters in on-screen keypad order
+			// (1 2 3 C / 4 5 6 D / 7 8 9 E / A 0 B F), e.g. "1234QWERASDFZXCV".
+			// Letters and digits only.
+			bool parse(const char *layout) noexcept;
+
+			// Returns the CHIP-8 key for a GLFW key code, or -1 if unmapped.
+			int lookup(int host_key) const noexcept {
+				return host_key >= 0 && host_key < table_size ? table[host_key] : -1;
+			}
+
+		private:
+			static constexpr int table_size = 128;  // Covers GLFW's printable key codes
+			signed char table[table_size];
+		};
+
+		// Single-threaded FIFO between GLFW callbacks and the emulator.
+		// GLFW delivers callbacks from glfwPollEvents() on the main thread.
+		class queue {
+		public:
+			void push(const event &e) noexcept;
+
+			// Applies queued events in order. A key released in the same batch
+			// it was pressed in stays down until release_deferred(), so the ROM
+			// gets at least one cycle to observe it.
+			void apply(chip8 &c) noexcept;
+			void release_deferred(chip8 &c) noexcept;
+
+			double last_event_time() const noexcept { return last_time; }
+
+		private:
+			static constexpr unsigned int capacity = 64;  // Power of two
+
+			event events[capacity];
+			unsigned int head = 0;
+			unsigned int tail = 0;
+			uint16_t deferred = 0;
+			double last_time = 0.0;
+		};
+	}
+}
+
+#endif //CHIP8_INPUT
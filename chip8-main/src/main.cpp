@@ -1,52 +1,65 @@
 // Copyright (c) 2020 udv. All rights reserved.
 
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include "chip8.hpp"
+#include "embedded_shaders.hpp"
+#include "input.hpp"
+#include "pool.hpp"
 #include "shader.hpp"
+#include "tables.hpp"
+#include "wall.hpp"
+#include "wall_view.hpp"
 
 //region Emulator
 chip8::chip8 *emulator;
+// Every running instance; `emulator` is the first. More than one is shown as a wall.
+std::vector<chip8::chip8 *> instances;
+//endregion
+//region Input
+chip8::input::keymap keymap;
+chip8::input::queue input_queue;
 //endregion
-
-unsigned int getIntFromColor(float Red, float Green, float Blue) {
-	unsigned int R = round(255 * Red);
-	unsigned int G = round(255 * Green);
-	unsigned int B = round(255 * Blue);
-
-	R = (R << 16) & 0x00FF0000;
-	G = (G << 8) & 0x0000FF00;
-	B = B & 0x000000FF;
-
-	return 0xFF000000u | R | G | B;
-}
 
 //region Display dimensions and data
 constexpr int display_size_modifier = 10;
 constexpr int display_width = DISPLAY_WIDTH * display_size_modifier;
 constexpr int display_height = DISPLAY_HEIGHT * display_size_modifier;
 
-unsigned int screen_data[DISPLAY_WIDTH][DISPLAY_HEIGHT] = {0};
+uint32_t screen_data[DISPLAY_HEIGHT][DISPLAY_WIDTH] = {};  // 0xAARRGGBB, row 0 at the top
 //endregion
 //region GLFW Callbacks
-void framebuffer_size_callback(GLFWwindow *window, int width, int height);
-int key_state(GLFWwindow *window, int key);
-void process_input(GLFWwindow *window);
+void framebuffer_size_callback(GLFWwindow *, int width, int height);
+void key_callback(GLFWwindow *window, int key, int, int action, int);
+void init_display_texture();
 void update_display_texture(const chip8::chip8 &c8);
 //endregion
+//region Emulation
+void run_instances(unsigned long cycles);
+bool any_drawn();
+const char *shader_source(const char *dir, const char *name, const char *embedded, std::string &storage);
+//endregion
 //region Texture
 GLuint display_texture;
 GLuint vbo, vao, ebo;
 
 constexpr float display_vertices[] = {
 		// Positions            // Texture coordinates
-		/*LB*/ -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-		/*RB*/  1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-		/*RT*/  1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
-		/*LT*/ -1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+		/*LB*/ -1.0f, -1.0f, 0.0f, 0.0f, 1.0f,
+		/*RB*/  1.0f, -1.0f, 0.0f, 1.0f, 1.0f,
+		/*RT*/  1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+		/*LT*/ -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
 };
 
 constexpr GLuint indices[] = {
@@ -54,18 +67,122 @@ constexpr GLuint indices[] = {
 		1, 2, 3  // second triangle
 };
 //endregion
+//region Wall
+// GL 3.3 guarantees 256 texture array layers, one per instance
+constexpr unsigned long max_wall = 256;
+std::unique_ptr<chip8::pool> wall_pool;
+chip8::wall::layout wall_grid;
+chip8::wall::view wall_view;
+//endregion
+//region Turbo
+// Reference speed for the multiplier: a typical CHIP-8 at 10 instructions per 60 Hz frame
+constexpr double nominal_ips = 600.0;
+constexpr unsigned long cycles_per_frame = 10;
+// Cycles run between checks for a due frame when --render-every is not given
+constexpr unsigned long turbo_slice = 4096;
+// Input is polled at least this often (seconds) while frames are being skipped
+constexpr double turbo_poll_interval = 1.0 / 240.0;
+// Window title refresh for the speed readout (seconds)
+constexpr double turbo_stats_interval = 0.5;
+//endregion
 
 int main(int argc, char **argv) {
 	//region Setup
-	emulator = new chip8::chip8{};
+	using clock = std::chrono::steady_clock;
+	auto launched = clock::now();
+
+	static chip8::chip8 instance{};
+	emulator = &instance;
 
 	if (argc < 2) {
-		printf("Usage: chip8.exe <game_filename>\n\n");
+		printf("Usage: chip8.exe <game_filename> [--keymap 1234QWERASDFZXCV] [--seed N] [--wall N]\n"
+		       "                 [--turbo] [--render-every N] [--max-fps M]\n"
+		       "                 [--shader-dir DIR] [--shader-cache FILE | --no-shader-cache]\n\n");
 		return 65;
 	}
 
-	if (!emulator->load_game(argv[1])) {
-		return 1;
+	const char *shader_dir = nullptr;
+	const char *shader_cache = "chip8-shaders.bin";
+	unsigned long wall_count = 1;
+	bool turbo = false;
+	unsigned long render_every = 0;     // Frames per presentation; 0 = limited by max_fps only
+	double max_fps = -1.0;              // < 0: not given
+
+	// Unseeded interactive runs still get a different game every time
+	emulator->seed((uint64_t) time(nullptr));
+
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			emulator->seed(strtoull(argv[++i], nullptr, 10));
+		} else if (strcmp(argv[i], "--keymap") == 0 && i + 1 < argc) {
+			if (!keymap.parse(argv[++i])) {
+				fprintf(stderr, "Invalid keymap '%s': expected 16 distinct letters or digits\n", argv[i]);
+				return 65;
+			}
+		} else if (strcmp(argv[i], "--wall") == 0 && i + 1 < argc) {
+			wall_count = strtoul(argv[++i], nullptr, 10);
+			if (wall_count == 0 || wall_count > max_wall) {
+				fprintf(stderr, "--wall takes 1 to %lu instances\n", max_wall);
+				return 65;
+			}
+		} else if (strcmp(argv[i], "--turbo") == 0) {
+			turbo = true;
+		} else if (strcmp(argv[i], "--render-every") == 0 && i + 1 < argc) {
+			turbo = true;
+			render_every = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc) {
+			turbo = true;
+			max_fps = strtod(argv[++i], nullptr);
+		} else if (strcmp(argv[i], "--shader-dir") == 0 && i + 1 < argc) {
+			shader_dir = argv[++i];
+		} else if (strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc) {
+			shader_cache = argv[++i];
+		} else if (strcmp(argv[i], "--no-shader-cache") == 0) {
+			shader_cache = nullptr;
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 65;
+		}
+	}
+
+	// Turbo presents at 60 fps unless a frame interval was asked for
+	if (max_fps < 0.0) {
+		max_fps = render_every != 0 ? 0.0 : 60.0;
+	}
+
+	// Read the ROM while the window and GL context come up; nothing else
+	// touches the emulator until the result is collected below.
+	double rom_ms = 0;
+	std::future<bool> rom_loaded = std::async(std::launch::async, [&rom_ms, game = argv[1]] {
+		auto start = clock::now();
+		bool loaded = emulator->load_game(game);
+		rom_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		return loaded;
+	});
+
+	bool wall_mode = wall_count > 1;
+	int window_width = display_width;
+	int window_height = display_height;
+	instances.push_back(emulator);
+	if (wall_mode) {
+		wall_pool.reset(new chip8::pool(wall_count - 1));
+		for (unsigned long i = 1; i < wall_count; ++i) {
+			chip8::chip8 *c = wall_pool->create();
+			if (c == nullptr) {
+				fprintf(stderr, "Cannot allocate %lu instances\n", wall_count);
+				return 1;
+			}
+			instances.push_back(c);
+		}
+
+		// Largest integer scale that keeps the wall on a typical screen
+		wall_grid = chip8::wall::arrange(wall_count);
+		int scale = display_size_modifier;
+		while (scale > 1 && (wall_grid.width() * scale > 1600 || wall_grid.height() * scale > 900)) {
+			--scale;
+		}
+		window_width = (int) wall_grid.width() * scale;
+		window_height = (int) wall_grid.height() * scale;
 	}
 	//endregion
 	//region GLFW Context
@@ -81,7 +198,7 @@ int main(int argc, char **argv) {
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-	GLFWwindow *window = glfwCreateWindow(display_width, display_height, "CHIP8", nullptr, nullptr);
+	GLFWwindow *window = glfwCreateWindow(window_width, window_height, "CHIP8", nullptr, nullptr);
 	if (window == nullptr) {
 		printf("Failed to create GLFW window");
 		glfwTerminate();
@@ -94,14 +211,209 @@ int main(int argc, char **argv) {
 		printf("Failed to initialize GLAD");
 		return -1;
 	}
+	double context_ms = std::chrono::duration<double, std::milli>(clock::now() - launched).count();
 	//endregion
 	//region Display setup
-	glViewport(0, 0, display_width, display_height);
+	glViewport(0, 0, window_width, window_height);
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetKeyCallback(window, key_callback);
 	//endregion
 	//region Texture
-	shader shader("texture.vs.glsl", "texture.fs.glsl");
+	// Built-in shaders unless a directory with replacements was given
+	auto shader_start = clock::now();
+	std::string vertex_file, fragment_file;
+	const char *vertex_code = wall_mode
+	                          ? shader_source(shader_dir, "wall.vs.glsl", chip8::shaders::wall_vs, vertex_file)
+	                          : shader_source(shader_dir, "texture.vs.glsl", chip8::shaders::texture_vs, vertex_file);
+	const char *fragment_code = wall_mode
+	                            ? shader_source(shader_dir, "wall.fs.glsl", chip8::shaders::wall_fs, fragment_file)
+	                            : shader_source(shader_dir, "texture.fs.glsl", chip8::shaders::texture_fs, fragment_file);
+	// One cache file per program, so switching modes does not evict the other one
+	std::string cache_path = shader_cache != nullptr ? shader_cache : "";
+	if (wall_mode && !cache_path.empty()) {
+		cache_path += ".wall";
+	}
+	shader shader(vertex_code, fragment_code, cache_path.empty() ? nullptr : cache_path.c_str());
+	double shader_ms = std::chrono::duration<double, std::milli>(clock::now() - shader_start).count();
+
+	if (wall_mode) {
+		wall_view.init(wall_grid, instances.size(), shader.ID);
+	} else {
+		init_display_texture();
+	}
+
+	shader.use();
+	//endregion
+
+	if (!rom_loaded.get()) {
+		glfwTerminate();
+		return 1;
+	}
+	// Wall instances run the same ROM, each with its own seed
+	for (size_t i = 1; i < instances.size(); ++i) {
+		*instances[i] = *emulator;
+		instances[i]->seed(emulator->current_seed() + i);
+	}
+
+	//region Main loop
+	bool first_frame = true;
+	// Turbo: emulation runs unthrottled in slices; a frame is presented only when
+	// one is due and something was drawn, otherwise rendering and the swap are skipped
+	unsigned long slice = render_every != 0 ? render_every * cycles_per_frame : turbo_slice;
+	double next_present = 0.0;
+	double next_poll = 0.0;
+	double stats_start = glfwGetTime();
+	unsigned long long stats_cycles = 0;
+	unsigned long stats_frames = 0;
+	glfwSwapInterval(0);
+	while (!glfwWindowShouldClose(window)) {
+		//region Emulator cycle
+		unsigned long cycles = turbo ? slice : 1;
+		run_instances(cycles);
+		//endregion
+		//region Presentation
+		bool present = true;
+		double now = 0.0;
+		if (turbo) {
+			now = glfwGetTime();
+			stats_cycles += cycles;
+			// Draw flags stay set across skipped frames, so any number of draws
+			// since the last presentation cost a single upload
+			present = now >= next_present && any_drawn();
+			if (present && max_fps > 0.0) {
+				next_present = now + 1.0 / max_fps;
+			}
+		}
+
+		if (present) {
+			if (wall_mode) {
+				// Only layers whose instance drew are uploaded; one draw call for the whole wall
+				wall_view.update(instances.data());
+				wall_view.draw();
+			} else {
+				if (emulator->draw_pending()) {
+					glClear(GL_COLOR_BUFFER_BIT);
+
+					update_display_texture(*emulator);
+
+					emulator->clear_draw();
+
+#ifdef DEBUG_TEXTURE
+					auto* pixels = new GLubyte[262144];
+					glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+					FILE* file = fopen("texture.tga", "w");
+					fprintf(file, "%s", pixels);
+					fclose(file);
+#endif
+				}
+
+				glBindTexture(GL_TEXTURE_2D, display_texture);
+				shader.use();
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+			}
+
+			glfwSwapBuffers(window);
+			++stats_frames;
+
+			if (first_frame) {
+				first_frame = false;
+				glFinish();
+				printf("First frame after %.1f ms (context %.1f ms, shaders %.1f ms %s, ROM %.1f ms in parallel)\n",
+				       std::chrono::duration<double, std::milli>(clock::now() - launched).count(), context_ms,
+				       shader_ms, shader.cached ? "from cache" : "compiled", rom_ms);
+			}
+		}
+
+		// Speed readout in the title bar: total IPS and the per-instance speed-up
+		if (turbo && now - stats_start >= turbo_stats_interval) {
+			double ips = stats_cycles * instances.size() / (now - stats_start);
+			char title[128];
+			snprintf(title, sizeof(title), "CHIP8 turbo - %.1fM IPS, %.0fx, %.0f fps", ips / 1e6,
+			         ips / instances.size() / nominal_ips, stats_frames / (now - stats_start));
+			glfwSetWindowTitle(window, title);
+			stats_start = now;
+			stats_cycles = 0;
+			stats_frames = 0;
+		}
+		//endregion
+
+		// FX0A halts the core until a key arrives; sleep in the event loop
+		// instead of spinning, waking at the 60 Hz timer rate at the latest.
+		bool waiting = true;
+		for (const chip8::chip8 *c : instances) {
+			waiting = waiting && c->waiting_for_key();
+		}
+		if (waiting) {
+			glfwWaitEventsTimeout(1.0 / 60.0);
+		} else if (!turbo || now >= next_poll) {
+			glfwPollEvents();
+			next_poll = now + turbo_poll_interval;
+		}
+	}
+	//endregion
 
+	if (wall_mode) {
+		wall_view.release();
+	} else {
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ebo);
+		glDeleteTextures(1, &display_texture);
+	}
+
+	glfwTerminate();
+	return 0;
+}
+
+void run_instances(unsigned long cycles) {
+	input_queue.apply(*emulator);
+	// The keypad drives every instance of the wall
+	for (size_t i = 1; i < instances.size(); ++i) {
+		if (instances[i]->key_mask() != emulator->key_mask()) {
+			instances[i]->set_keys(emulator->key_mask());
+		}
+	}
+	for (chip8::chip8 *c : instances) {
+		c->cycle();
+	}
+	input_queue.release_deferred(*emulator);
+
+	if (instances.size() == 1) {
+		for (unsigned long n = 1; n < cycles; ++n) {
+			emulator->cycle();
+		}
+		return;
+	}
+	for (unsigned long n = 1; n < cycles; ++n) {
+		for (chip8::chip8 *c : instances) {
+			c->cycle();
+		}
+	}
+}
+
+bool any_drawn() {
+	for (const chip8::chip8 *c : instances) {
+		if (c->draw_pending()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *shader_source(const char *dir, const char *name, const char *embedded, std::string &storage) {
+	if (dir == nullptr) {
+		return embedded;
+	}
+	if (shader::readFile((std::string(dir) + "/" + name).c_str(), storage)) {
+		return storage.c_str();
+	}
+	fprintf(stderr, "Falling back to built-in %s\n", name);
+	return embedded;
+}
+
+void init_display_texture() {
 	glGenVertexArrays(1, &vao);
 	glGenBuffers(1, &vbo);
 	glGenBuffers(1, &ebo);
@@ -132,117 +444,46 @@ int main(int argc, char **argv) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
 	// Clear screen data
-	for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y) {
-		for (unsigned int x = 0; x < DISPLAY_WIDTH; ++x) {
-			screen_data[x][y] = getIntFromColor(0.5f, 0.5f, 0.5f);
+	for (auto &row : screen_data) {
+		for (uint32_t &pixel : row) {
+			pixel = chip8::tables::background;
 		}
 	}
 
-	// Create a texture
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, DISPLAY_WIDTH, DISPLAY_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE,
+	// Create a texture; 0xAARRGGBB words are BGRA bytes in memory
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, DISPLAY_WIDTH, DISPLAY_HEIGHT, 0, GL_BGRA, GL_UNSIGNED_BYTE,
 	             (GLvoid *) screen_data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	shader.use();
-	//endregion
-
-	//region Main loop
-	glfwSwapInterval(0);
-	while (!glfwWindowShouldClose(window)) {
-		process_input(window);
-
-		//region Emulator cycle
-		emulator->cycle();
-		if (emulator->draw) {
-			glClear(GL_COLOR_BUFFER_BIT);
-
-			// update_display_texture(*emulator);
-
-			emulator->draw = false;
-
-#ifdef DEBUG_TEXTURE
-			auto* pixels = new GLubyte[262144];
-			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
-			FILE* file = fopen("texture.tga", "w");
-			fprintf(file, "%s", pixels);
-			fclose(file);
-#endif
-		}
-
-		glBindTexture(GL_TEXTURE_2D, display_texture);
-		shader.use();
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-
-		glfwSwapBuffers(window);
-		glfwPollEvents();
-	}
-	//endregion
-
-	glDeleteVertexArrays(1, &vao);
-	glDeleteBuffers(1, &vbo);
-	glDeleteBuffers(1, &ebo);
-
-	glfwTerminate();
-	return 0;
 }
 
 void update_display_texture(const chip8::chip8 &c8) {
 	glBindTexture(GL_TEXTURE_2D, display_texture);
 	// Update pixels
-	for (int x = 0; x < DISPLAY_WIDTH; ++x) {
-		for (int y = 0; y < DISPLAY_HEIGHT; ++y) {
-			if (c8.gfx[(y * DISPLAY_WIDTH) + x] == 0) {
-				screen_data[x][y] = getIntFromColor(0, 0, 0);    // Disabled
-			} else {
-				screen_data[x][y] = getIntFromColor(1, 1, 1);  // Enabled
-			}
-			// screen_data[x][y] = getIntFromColor(x, y, 1);
+	const unsigned char *pixel = c8.framebuffer();
+	for (auto &row : screen_data) {
+		for (uint32_t &texel : row) {
+			texel = chip8::tables::palette[*pixel++ & 0x1u];
 		}
 	}
 
 	// Update Texture
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, DISPLAY_WIDTH, DISPLAY_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE,
-	             (GLvoid *) screen_data);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, GL_BGRA, GL_UNSIGNED_BYTE,
+	                (GLvoid *) screen_data);
 }
 
-void process_input(GLFWwindow *window) {
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+void key_callback(GLFWwindow *window, int key, int, int action, int) {
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, true);
+		return;
 	}
 
-	emulator->key[0x1] = key_state(window, GLFW_KEY_1);
-	emulator->key[0x2] = key_state(window, GLFW_KEY_2);
-	emulator->key[0x3] = key_state(window, GLFW_KEY_3);
-	emulator->key[0xC] = key_state(window, GLFW_KEY_4);
-
-	emulator->key[0x4] = key_state(window, GLFW_KEY_Q);
-	emulator->key[0x5] = key_state(window, GLFW_KEY_W);
-	emulator->key[0x6] = key_state(window, GLFW_KEY_E);
-	emulator->key[0xD] = key_state(window, GLFW_KEY_R);
-
-	emulator->key[0x7] = key_state(window, GLFW_KEY_A);
-	emulator->key[0x8] = key_state(window, GLFW_KEY_S);
-	emulator->key[0x9] = key_state(window, GLFW_KEY_D);
-	emulator->key[0xE] = key_state(window, GLFW_KEY_F);
-
-	emulator->key[0xA] = key_state(window, GLFW_KEY_Z);
-	emulator->key[0x0] = key_state(window, GLFW_KEY_X);
-	emulator->key[0xB] = key_state(window, GLFW_KEY_C);
-	emulator->key[0xF] = key_state(window, GLFW_KEY_V);
-}
-
-int key_state(GLFWwindow *window, int key) {
-	if (glfwGetKey(window, key) == GLFW_PRESS) {
-		return 1;
-	} else if (glfwGetKey(window, key) == GLFW_RELEASE) {
-		return 0;
+	int chip8_key = keymap.lookup(key);
+	if (chip8_key < 0 || action == GLFW_REPEAT) {
+		return;
 	}
-	return 0;
+
+	input_queue.push({glfwGetTime(), (unsigned char) chip8_key, action == GLFW_PRESS});
 }
 
-void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
+void framebuffer_size_callback(GLFWwindow *, int width, int height) {
 	glViewport(0, 0, width, height);
 }
\ No newline at end of file
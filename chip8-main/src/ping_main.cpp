@@ -0,0 +1,162 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "control_protocol.hpp"
+
+using namespace chip8::control;
+
+//region Socket
+bool write_all(int fd, const void *data, size_t size) {
+	auto bytes = (const unsigned char *) data;
+	while (size != 0) {
+		ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+		bytes += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool read_all(int fd, void *data, size_t size) {
+	auto bytes = (unsigned char *) data;
+	while (size != 0) {
+		ssize_t received = read(fd, bytes, size);
+		if (received < 0 && errno == EINTR) {
+			continue;
+		}
+		if (received <= 0) {
+			return false;
+		}
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+int connect_to(const char *socket_path) {
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "socket path too long: '%s'\n", socket_path);
+		return -1;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "cannot create socket: %s\n", strerror(errno));
+		return -1;
+	}
+	if (connect(fd, (sockaddr *) &address, sizeof(address)) != 0) {
+		fprintf(stderr, "cannot connect to '%s': %s\n", socket_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+//endregion
+
+// One request/reply exchange; returns false on a transport error or a non-ok status.
+bool round_trip(int fd, op code, const void *payload, uint32_t length, std::vector<unsigned char> &reply) {
+	header request{};
+	request.code = code;
+	request.length = length;
+	if (!write_all(fd, &request, sizeof(request)) || (length != 0 && !write_all(fd, payload, length))) {
+		return false;
+	}
+
+	header response{};
+	if (!read_all(fd, &response, sizeof(response)) || response.length > max_payload) {
+		return false;
+	}
+	reply.resize(response.length);
+	if (response.length != 0 && !read_all(fd, reply.data(), response.length)) {
+		return false;
+	}
+	return response.code == code && response.result == status::ok;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		printf("Usage: chip8-ping <socket_path> [--count N] [--cycles N]\n\n");
+		return 65;
+	}
+
+	unsigned long count = 10000;
+	uint32_t cycles = 0;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+			count = strtoul(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+			cycles = (uint32_t) strtoul(argv[++i], nullptr, 10);
+		} else {
+			fprintf(stderr, "unknown option '%s'\n", argv[i]);
+			return 65;
+		}
+	}
+	if (count == 0) {
+		fputs("--count must be at least 1\n", stderr);
+		return 65;
+	}
+
+	int fd = connect_to(argv[1]);
+	if (fd < 0) {
+		return 1;
+	}
+
+	// With --cycles each exchange is a step request, otherwise a register read;
+	// both are answered without touching the framebuffer
+	op code = cycles != 0 ? op::step : op::read_registers;
+	const void *payload = cycles != 0 ? &cycles : nullptr;
+	uint32_t length = cycles != 0 ? sizeof(cycles) : 0;
+
+	std::vector<unsigned char> reply;
+	std::vector<double> samples;
+	samples.reserve(count);
+
+	// Warm up the connection and both processes' caches before timing
+	for (int i = 0; i < 100; ++i) {
+		if (!round_trip(fd, code, payload, length, reply)) {
+			fputs("request failed\n", stderr);
+			close(fd);
+			return 1;
+		}
+	}
+
+	for (unsigned long i = 0; i < count; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		bool ok = round_trip(fd, code, payload, length, reply);
+		auto end = std::chrono::steady_clock::now();
+		if (!ok) {
+			fputs("request failed\n", stderr);
+			close(fd);
+			return 1;
+		}
+		samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+	}
+	close(fd);
+
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) {
+		return samples[std::min(samples.size() - 1, (size_t) (p * (double) samples.size()))];
+	};
+	printf("%lu round trips: min %.2f us, median %.2f us, p99 %.2f us, max %.2f us\n",
+	       count, samples.front(), percentile(0.5), percentile(0.99), samples.back());
+	return 0;
+}
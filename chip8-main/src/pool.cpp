@@ -0,0 +1,111 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cstdio>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "pool.hpp"
+
+namespace chip8 {
+#if defined(__linux__)
+	constexpr size_t huge_page_size = 2u * 1024u * 1024u;
+#endif
+
+	pool::pool(size_t capacity) {
+		size_t bytes = capacity * sizeof(slot);
+		if (bytes == 0) {
+			return;
+		}
+
+#if defined(_WIN32)
+		slots = static_cast<slot *>(_aligned_malloc(bytes, alignof(slot)));
+#else
+		void *block = MAP_FAILED;
+#if defined(__linux__)
+		// Explicit huge pages first; they are only there if the admin reserved them.
+		size_t huge_bytes = (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+		block = mmap(nullptr, huge_bytes, PROT_READ | PROT_WRITE,
+		             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (block != MAP_FAILED) {
+			bytes = huge_bytes;
+			huge = true;
+		}
+#endif
+		if (block == MAP_FAILED) {
+			block = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+			// Fall back to transparent huge pages for large pools
+			if (block != MAP_FAILED && bytes >= huge_page_size) {
+				huge = madvise(block, bytes, MADV_HUGEPAGE) == 0;
+			}
+#endif
+		}
+		slots = block == MAP_FAILED ? nullptr : static_cast<slot *>(block);
+#endif
+
+		if (slots == nullptr) {
+			fprintf(stderr, "cannot reserve pool of %zu instances\n", capacity);
+			huge = false;
+			return;
+		}
+
+		mapped_bytes = bytes;
+		slot_count = capacity;
+
+		// Thread the free list through the slots, lowest address first
+		for (size_t i = 0; i < slot_count; ++i) {
+			slots[i].next = i + 1 < slot_count ? &slots[i + 1] : nullptr;
+		}
+		free_list = slots;
+	}
+
+	pool::~pool() {
+		if (slots == nullptr) {
+			return;
+		}
+
+#if defined(_WIN32)
+		_aligned_free(slots);
+#else
+		munmap(slots, mapped_bytes);
+#endif
+	}
+
+	chip8 *pool::create() noexcept {
+		if (free_list == nullptr) {
+			return nullptr;
+		}
+
+		slot *s = free_list;
+		free_list = s->next;
+		++used;
+		// Value-initialised: every instance starts zeroed, seed included
+		return new(s->storage) chip8{};
+	}
+
+	chip8 *pool::create(const unsigned char *rom, size_t size) noexcept {
+		chip8 *instance = create();
+		if (instance != nullptr && !instance->load_rom(rom, size)) {
+			destroy(instance);
+			return nullptr;
+		}
+		return instance;
+	}
+
+	void pool::destroy(chip8 *instance) noexcept {
+		if (instance == nullptr) {
+			return;
+		}
+
+		instance->~chip8();
+		auto *s = reinterpret_cast<slot *>(instance);
+		s->next = free_list;
+		free_list = s;
+		--used;
+	}
+}
@@ -0,0 +1,51 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_POOL
+#define CHIP8_POOL
+
+#include <cstddef>
+
+#include "chip8.hpp"
+
+namespace chip8 {
+	// Fixed-capacity arena of emulator instances.
+	// All slots are reserved up front in one cache-line-aligned block (backed by
+	// huge pages where the OS allows it), so create/destroy never touch the heap.
+	class pool {
+	public:
+		explicit pool(size_t capacity);
+		~pool();
+
+		pool(const pool &) = delete;
+		pool &operator=(const pool &) = delete;
+
+		// Constructs an instance in a free slot. Returns nullptr when the pool is exhausted.
+		chip8 *create() noexcept;
+		// Constructs an instance in a free slot and loads the ROM into it.
+		// Returns nullptr when the pool is exhausted or the ROM does not fit.
+		chip8 *create(const unsigned char *rom, size_t size) noexcept;
+		void destroy(chip8 *instance) noexcept;
+
+		size_t capacity() const noexcept { return slot_count; }
+		size_t size() const noexcept { return used; }
+		bool huge_pages() const noexcept { return huge; }
+
+	private:
+		struct alignas(64) slot {
+			union {
+				slot *next;
+				unsigned char storage[sizeof(chip8)];
+			};
+		};
+		static_assert(sizeof(slot) == sizeof(chip8), "slots must pack without padding");
+
+		slot *slots = nullptr;
+		slot *free_list = nullptr;
+		size_t slot_count = 0;
+		size_t used = 0;
+		size_t mapped_bytes = 0;
+		bool huge = false;
+	};
+}
+
+#endif //CHIP8_POOL
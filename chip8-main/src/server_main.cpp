@@ -0,0 +1,36 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <csignal>
+#include <cstdio>
+
+#include "control_server.hpp"
+
+//region Server
+chip8::control::server *control_server;
+//endregion
+
+void stop_server(int) {
+	control_server->stop();
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		printf("Usage: chip8-server <socket_path>\n\n");
+		return 65;
+	}
+
+	static chip8::control::server server;
+	control_server = &server;
+	if (!server.open(argv[1])) {
+		return 1;
+	}
+
+	// No SA_RESTART: a signal has to interrupt accept()/read() so the loop sees the stop
+	struct sigaction action{};
+	action.sa_handler = stop_server;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	printf("Listening on %s\n", argv[1]);
+	return server.run() ? 0 : 1;
+}
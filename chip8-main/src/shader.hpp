@@ -5,97 +5,68 @@
 
 #include <glad/glad.h>
 
-#include <string>
-#include <fstream>
-#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+
+// Program binaries are core in 4.1 and available earlier through ARB_get_program_binary
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+#define CHIP8_PROGRAM_BINARY
+#endif
 
 class shader
 {
 public:
 	unsigned int ID;
-	// constructor generates the shader on the fly
+	// true if the program was restored from the binary cache instead of compiled
+	bool cached = false;
+
+	// constructor builds the program from GLSL source; with a cache path, a
+	// program binary saved by an earlier run with the same sources and driver is
+	// loaded instead, and a freshly linked program is saved for the next run
 	// ------------------------------------------------------------------------
-	shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	shader(const char* vertexCode, const char* fragmentCode, const char* cachePath = nullptr)
 	{
-		// 1. retrieve the vertex/fragment source code from filePath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-		try
-		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			// if geometry shader path is present, also load a geometry shader
-			if(geometryPath != nullptr)
-			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
-			}
-		}
-		catch (std::ifstream::failure& e)
+		bool useCache = cachePath != nullptr && binariesSupported();
+		uint64_t key = useCache ? cacheKey(vertexCode, fragmentCode) : 0;
+
+		ID = glCreateProgram();
+		if(useCache && loadBinary(cachePath, key))
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			cached = true;
+			return;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
+
+		// 1. compile shaders
 		unsigned int vertex, fragment;
 		// vertex shader
 		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, nullptr);
+		glShaderSource(vertex, 1, &vertexCode, nullptr);
 		glCompileShader(vertex);
 		checkCompileErrors(vertex, "VERTEX");
 		// fragment Shader
 		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, nullptr);
+		glShaderSource(fragment, 1, &fragmentCode, nullptr);
 		glCompileShader(fragment);
 		checkCompileErrors(fragment, "FRAGMENT");
-		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if(geometryPath != nullptr)
-		{
-			const char * gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, nullptr);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
-		}
-		// shader Program
-		ID = glCreateProgram();
+		// 2. shader Program
 		glAttachShader(ID, vertex);
 		glAttachShader(ID, fragment);
-		if(geometryPath != nullptr)
-			glAttachShader(ID, geometry);
+#ifdef CHIP8_PROGRAM_BINARY
+		if(useCache)
+			glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
 		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
+		bool linked = checkCompileErrors(ID, "PROGRAM");
 		// delete the shaders as they're linked into our program now and no longer necessery
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
-		if(geometryPath != nullptr)
-			glDeleteShader(geometry);
 
+		if(useCache && linked)
+			saveBinary(cachePath, key);
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
@@ -103,11 +74,152 @@ public:
 	{
 		glUseProgram(ID);
 	}
+	// read a shader source file; prints an error and returns false if it is missing or empty
+	// ------------------------------------------------------------------------
+	static bool readFile(const char* path, std::string& code)
+	{
+		FILE* file = fopen(path, "rb");
+		if(file == nullptr)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+			return false;
+		}
+		code.clear();
+		char buffer[4096];
+		size_t got;
+		while((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			code.append(buffer, got);
+		bool ok = ferror(file) == 0 && !code.empty();
+		fclose(file);
+		if(!ok)
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+		return ok;
+	}
 
 private:
+	// cache file: magic, key, binary format, binary length, binary
+	// (real program binaries are a few KB to a few hundred KB)
+	static constexpr uint32_t maxBinaryLength = 64u * 1024u * 1024u;
+	struct cacheHeader
+	{
+		char magic[4];
+		uint64_t key;
+		uint32_t format;
+		uint32_t length;
+	};
+
+	static bool binariesSupported()
+	{
+#ifdef CHIP8_PROGRAM_BINARY
+		bool available = false;
+#ifdef GL_VERSION_4_1
+		available = available || GLAD_GL_VERSION_4_1;
+#endif
+#ifdef GL_ARB_get_program_binary
+		available = available || GLAD_GL_ARB_get_program_binary;
+#endif
+		GLint formats = 0;
+		if(available)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+#else
+		return false;
+#endif
+	}
+	// FNV-1a over the sources and the driver identity, so a driver update or a
+	// shader edit invalidates the cache
+	// ------------------------------------------------------------------------
+	static uint64_t cacheKey(const char* vertexCode, const char* fragmentCode)
+	{
+		const char* parts[] = {
+				vertexCode,
+				fragmentCode,
+				(const char*) glGetString(GL_VENDOR),
+				(const char*) glGetString(GL_RENDERER),
+				(const char*) glGetString(GL_VERSION),
+		};
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for(const char* part : parts)
+		{
+			for(const char* c = part != nullptr ? part : ""; *c != '\0'; ++c)
+				hash = (hash ^ (unsigned char) *c) * 0x100000001B3ull;
+			hash = (hash ^ 0xFFu) * 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	bool loadBinary(const char* cachePath, uint64_t key)
+	{
+#ifdef CHIP8_PROGRAM_BINARY
+		FILE* file = fopen(cachePath, "rb");
+		if(file == nullptr)
+			return false;
+		cacheHeader header{};
+		bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "C8PB", 4) == 0 &&
+		          header.key == key && header.length > 0 && header.length <= maxBinaryLength;
+		// the length must match what is actually left in the file; a truncated or
+		// padded cache is treated as a miss
+		if(ok)
+		{
+			long start = ftell(file);
+			ok = start >= 0 && fseek(file, 0, SEEK_END) == 0;
+			long end = ok ? ftell(file) : -1;
+			ok = ok && end - start == (long) header.length && fseek(file, start, SEEK_SET) == 0;
+		}
+		std::unique_ptr<char[]> binary;
+		if(ok)
+		{
+			binary.reset(new char[header.length]);
+			ok = fread(binary.get(), 1, header.length, file) == header.length;
+		}
+		fclose(file);
+		if(!ok)
+			return false;
+
+		glProgramBinary(ID, header.format, binary.get(), (GLsizei) header.length);
+		GLint success;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if(!success)
+		{
+			// the driver rejected it; start over with a fresh program object
+			glDeleteProgram(ID);
+			ID = glCreateProgram();
+		}
+		return success != 0;
+#else
+		return false;
+#endif
+	}
+
+	void saveBinary(const char* cachePath, uint64_t key) const
+	{
+#ifdef CHIP8_PROGRAM_BINARY
+		GLint length = 0;
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if(length <= 0)
+			return;
+		cacheHeader header{{'C', '8', 'P', 'B'}, key, 0, 0};
+		std::unique_ptr<char[]> binary(new char[length]);
+		GLenum format;
+		GLsizei written = 0;
+		glGetProgramBinary(ID, length, &written, &format, binary.get());
+		header.format = format;
+		header.length = (uint32_t) written;
+
+		FILE* file = fopen(cachePath, "wb");
+		if(file == nullptr)
+		{
+			std::cout << "WARNING::SHADER::CACHE_NOT_WRITTEN: " << cachePath << std::endl;
+			return;
+		}
+		fwrite(&header, sizeof(header), 1, file);
+		fwrite(binary.get(), 1, written, file);
+		fclose(file);
+#endif
+	}
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
-	static void checkCompileErrors(GLuint shader, const std::string& type)
+	static bool checkCompileErrors(GLuint shader, const std::string& type)
 	{
 		GLint success;
 		GLchar infoLog[1024];
@@ -129,6 +241,7 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success != 0;
 	}
 };
 #endif //CHIP8_SHADER
@@ -0,0 +1,100 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_TABLES
+#define CHIP8_TABLES
+
+#include <array>
+#include <cstdint>
+
+// Lookup tables generated at compile time for the interpreter and renderer hot paths.
+namespace chip8 {
+	namespace tables {
+		//region BCD (FX33)
+		struct bcd_digits {
+			unsigned char hundreds;
+			unsigned char tens;
+			unsigned char ones;
+		};
+
+		constexpr std::array<bcd_digits, 256> make_bcd() {
+			std::array<bcd_digits, 256> table{};
+			for (unsigned int v = 0; v < 256; ++v) {
+				table[v] = {(unsigned char) (v / 100), (unsigned char) (v / 10 % 10), (unsigned char) (v % 10)};
+			}
+			return table;
+		}
+
+		inline constexpr std::array<bcd_digits, 256> bcd = make_bcd();
+		//endregion
+		//region Sprite row expansion (DXYN)
+		// One sprite byte as eight one-byte pixels, leftmost pixel first.
+		struct pixel_row {
+			unsigned char pixels[8];
+		};
+
+		constexpr std::array<pixel_row, 256> make_expand() {
+			std::array<pixel_row, 256> table{};
+			for (unsigned int v = 0; v < 256; ++v) {
+				for (unsigned int bit = 0; bit < 8; ++bit) {
+					table[v].pixels[bit] = (v >> (7u - bit)) & 0x1u;
+				}
+			}
+			return table;
+		}
+
+		inline constexpr std::array<pixel_row, 256> expand = make_expand();
+		//endregion
+		//region Font addresses (FX29)
+		// Only the low nibble of VX selects a glyph; each glyph is 5 bytes at address 0.
+		constexpr std::array<uint16_t, 256> make_font_address() {
+			std::array<uint16_t, 256> table{};
+			for (unsigned int v = 0; v < 256; ++v) {
+				table[v] = (uint16_t) ((v & 0xFu) * 5u);
+			}
+			return table;
+		}
+
+		inline constexpr std::array<uint16_t, 256> font_address = make_font_address();
+		//endregion
+		//region Palette
+		// Packs a normalized color into 0xAARRGGBB, rounding to nearest.
+		constexpr uint32_t color(float red, float green, float blue) {
+			return 0xFF000000u |
+			       (uint32_t) (255.0f * red + 0.5f) << 16u |
+			       (uint32_t) (255.0f * green + 0.5f) << 8u |
+			       (uint32_t) (255.0f * blue + 0.5f);
+		}
+
+		// Indexed by framebuffer pixel value
+		inline constexpr std::array<uint32_t, 2> palette = {{
+				color(0.0f, 0.0f, 0.0f),    // Disabled
+				color(1.0f, 1.0f, 1.0f),    // Enabled
+		}};
+
+		inline constexpr uint32_t background = color(0.5f, 0.5f, 0.5f);
+		//endregion
+
+		//region Validation
+		static_assert(bcd[0].hundreds == 0 && bcd[0].tens == 0 && bcd[0].ones == 0, "bcd(0)");
+		static_assert(bcd[9].hundreds == 0 && bcd[9].tens == 0 && bcd[9].ones == 9, "bcd(9)");
+		static_assert(bcd[10].hundreds == 0 && bcd[10].tens == 1 && bcd[10].ones == 0, "bcd(10)");
+		static_assert(bcd[128].hundreds == 1 && bcd[128].tens == 2 && bcd[128].ones == 8, "bcd(128)");
+		static_assert(bcd[255].hundreds == 2 && bcd[255].tens == 5 && bcd[255].ones == 5, "bcd(255)");
+
+		static_assert(expand[0x80].pixels[0] == 1 && expand[0x80].pixels[1] == 0, "MSB is the leftmost pixel");
+		static_assert(expand[0x01].pixels[7] == 1 && expand[0x01].pixels[6] == 0, "LSB is the rightmost pixel");
+		static_assert(expand[0xA5].pixels[0] == 1 && expand[0xA5].pixels[1] == 0 &&
+		              expand[0xA5].pixels[2] == 1 && expand[0xA5].pixels[5] == 1 &&
+		              expand[0xA5].pixels[7] == 1 && expand[0xA5].pixels[6] == 0, "expand(0xA5)");
+		static_assert(sizeof(pixel_row) == 8, "rows are loaded as one 64-bit word");
+
+		static_assert(font_address[0x0] == 0 && font_address[0xF] == 75, "font glyphs are 5 bytes apart");
+		static_assert(font_address[0x1A] == font_address[0xA], "only the low nibble selects a glyph");
+
+		static_assert(palette[0] == 0xFF000000u && palette[1] == 0xFFFFFFFFu, "palette");
+		static_assert(background == 0xFF808080u, "0.5 rounds to 128");
+		//endregion
+	}
+}
+
+#endif //CHIP8_TABLES
@@ -0,0 +1,477 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cerrno>
+#include <cstring>
+
+#include "trace.hpp"
+
+namespace chip8 {
+	namespace trace {
+		constexpr char magic[4] = {'C', '8', 'T', 'R'};
+		constexpr unsigned char version = 1;
+		constexpr size_t block_header_size = 9;
+
+		enum method : unsigned char {
+			stored = 0,
+			lz = 1,
+		};
+
+		//region Encoding helpers
+		static unsigned char *put_varint(unsigned char *out, uint32_t value) noexcept {
+			while (value >= 0x80u) {
+				*out++ = (unsigned char) (value | 0x80u);
+				value >>= 7u;
+			}
+			*out++ = (unsigned char) value;
+			return out;
+		}
+
+		static bool get_varint(const unsigned char *&in, const unsigned char *end, uint32_t &value) noexcept {
+			value = 0;
+			for (unsigned int shift = 0; shift < 35; shift += 7) {
+				if (in == end) {
+					return false;
+				}
+				unsigned char byte = *in++;
+				value |= (uint32_t) (byte & 0x7Fu) << shift;
+				if ((byte & 0x80u) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// One bit per non-zero byte of `x`, byte 0 in bit 0
+		static uint32_t byte_mask(uint64_t x) noexcept {
+			constexpr uint64_t low = 0x7F7F7F7F7F7F7F7Full;
+			uint64_t high = (((x & low) + low) | x) & ~low;
+			return (uint32_t) (((high >> 7u) * 0x0102040810204080ull) >> 56u);
+		}
+
+		static unsigned int count_trailing_zeros(uint32_t x) noexcept {
+#if defined(__GNUC__)
+			return __builtin_ctz(x);
+#else
+			unsigned int n = 0;
+			while ((x & 1u) == 0) {
+				x >>= 1u;
+				++n;
+			}
+			return n;
+#endif
+		}
+
+		static void put_u32(unsigned char *out, uint32_t value) noexcept {
+			out[0] = value;
+			out[1] = value >> 8u;
+			out[2] = value >> 16u;
+			out[3] = value >> 24u;
+		}
+
+		static uint32_t get_u32(const unsigned char *in) noexcept {
+			return in[0] | in[1] << 8u | in[2] << 16u | (uint32_t) in[3] << 24u;
+		}
+		//endregion
+		//region LZ
+		constexpr size_t lz_min_match = 4;
+		constexpr unsigned int lz_hash_bits = 12;
+
+		static unsigned char *put_length(unsigned char *out, size_t length) noexcept {
+			while (length >= 255) {
+				*out++ = 255;
+				length -= 255;
+			}
+			*out++ = (unsigned char) length;
+			return out;
+		}
+
+		static bool get_length(const unsigned char *&in, const unsigned char *end, size_t &length) noexcept {
+			unsigned char byte;
+			do {
+				if (in == end) {
+					return false;
+				}
+				byte = *in++;
+				length += byte;
+			} while (byte == 255);
+			return true;
+		}
+
+		// One sequence: literals, then (unless final) a back-reference
+		static unsigned char *put_sequence(unsigned char *out, const unsigned char *literals, size_t literal_length,
+		                                   size_t offset, size_t match_length) noexcept {
+			size_t match_code = match_length == 0 ? 0 : match_length - lz_min_match;
+			*out++ = (unsigned char) ((literal_length < 15 ? literal_length : 15) << 4u |
+			                          (match_code < 15 ? match_code : 15));
+			if (literal_length >= 15) {
+				out = put_length(out, literal_length - 15);
+			}
+			memcpy(out, literals, literal_length);
+			out += literal_length;
+
+			if (match_length != 0) {
+				*out++ = (unsigned char) offset;
+				*out++ = (unsigned char) (offset >> 8u);
+				if (match_code >= 15) {
+					out = put_length(out, match_code - 15);
+				}
+			}
+			return out;
+		}
+
+		size_t lz_compress(const unsigned char *in, size_t size, unsigned char *out) noexcept {
+			uint32_t table[1u << lz_hash_bits] = {};
+			unsigned char *o = out;
+			size_t anchor = 0;
+			size_t pos = 0;
+
+			while (pos + lz_min_match <= size) {
+				uint32_t sequence;
+				memcpy(&sequence, in + pos, sizeof(sequence));
+				uint32_t hash = (sequence * 2654435761u) >> (32u - lz_hash_bits);
+				size_t candidate = table[hash];
+				table[hash] = (uint32_t) pos;
+
+				if (candidate < pos && pos - candidate <= 0xFFFFu &&
+				    memcmp(in + candidate, in + pos, lz_min_match) == 0) {
+					size_t length = lz_min_match;
+					while (pos + length < size && in[candidate + length] == in[pos + length]) {
+						++length;
+					}
+					o = put_sequence(o, in + anchor, pos - anchor, pos - candidate, length);
+					pos += length;
+					anchor = pos;
+				} else {
+					++pos;
+				}
+			}
+
+			o = put_sequence(o, in + anchor, size - anchor, 0, 0);
+			return o - out;
+		}
+
+		bool lz_decompress(const unsigned char *in, size_t size, unsigned char *out, size_t out_size) noexcept {
+			const unsigned char *end = in + size;
+			size_t o = 0;
+
+			while (in < end) {
+				unsigned char token = *in++;
+
+				size_t literal_length = token >> 4u;
+				if (literal_length == 15 && !get_length(in, end, literal_length)) {
+					return false;
+				}
+				if (literal_length > (size_t) (end - in) || literal_length > out_size - o) {
+					return false;
+				}
+				memcpy(out + o, in, literal_length);
+				in += literal_length;
+				o += literal_length;
+
+				if (in == end) {
+					break;
+				}
+
+				if (end - in < 2) {
+					return false;
+				}
+				size_t offset = in[0] | in[1] << 8u;
+				in += 2;
+				size_t match_length = token & 0x0Fu;
+				if (match_length == 15 && !get_length(in, end, match_length)) {
+					return false;
+				}
+				match_length += lz_min_match;
+				if (offset == 0 || offset > o || match_length > out_size - o) {
+					return false;
+				}
+
+				// Overlapping copies repeat the pattern, so copy forwards byte by byte
+				const unsigned char *from = out + o - offset;
+				for (size_t i = 0; i < match_length; ++i) {
+					out[o + i] = from[i];
+				}
+				o += match_length;
+			}
+			return o == out_size;
+		}
+		//endregion
+		//region Writer
+		writer::~writer() {
+			close();
+		}
+
+		bool writer::open(const char *filename, bool compress_blocks) {
+			file = fopen(filename, "wb");
+			if (file == nullptr) {
+				fprintf(stderr, "cannot open file '%s': %s\n", filename, strerror(errno));
+				return false;
+			}
+
+			fwrite(magic, 1, sizeof(magic), file);
+			fputc(version, file);
+
+			compress = compress_blocks;
+			buffers[0].reset(new unsigned char[block_size]);
+			buffers[1].reset(new unsigned char[block_size]);
+			packed.reset(new unsigned char[lz_bound(block_size)]);
+			thread = std::thread(&writer::worker, this);
+			return true;
+		}
+
+		void writer::step(chip8 &c) noexcept {
+			//region Capture
+			uint16_t pc = c.program_counter();
+			uint64_t V[2];
+			memcpy(V, c.registers(), sizeof(V));
+			uint16_t I = c.index_register();
+			uint16_t sp = c.stack_pointer();
+			unsigned char delay_timer = c.delay() > 0 ? c.delay() - 1 : 0;
+			unsigned char sound_timer = c.sound() > 0 ? c.sound() - 1 : 0;
+
+			c.cycle();
+
+			uint64_t after[2];
+			memcpy(after, c.registers(), sizeof(after));
+			uint32_t changed = (c.delay() != delay_timer ? change::delay_timer : 0u) |
+			                   (c.sound() != sound_timer ? change::sound_timer : 0u) |
+			                   (c.index_register() != I ? change::index : 0u) |
+			                   (c.stack_pointer() != sp ? change::stack_pointer : 0u) |
+			                   byte_mask(V[0] ^ after[0]) << 4u | byte_mask(V[1] ^ after[1]) << 12u;
+			if (first) {
+				changed = ~0u >> (32u - 20u);
+				first = false;
+			}
+			//endregion
+			//region Encode
+			if (fill + max_record > block_size) {
+				flush_active();
+			}
+
+			unsigned char *out = buffers[active].get() + fill;
+			auto delta = (int32_t) pc - (int32_t) last_pc;
+			out = put_varint(out, ((uint32_t) delta << 1u) ^ (uint32_t) (delta >> 31));
+			*out++ = (unsigned char) (c.current_opcode() >> 8u);
+			*out++ = (unsigned char) c.current_opcode();
+			out = put_varint(out, changed);
+
+			if (changed & (change::delay_timer | change::sound_timer | change::index | change::stack_pointer)) {
+				if (changed & change::delay_timer) {
+					*out++ = c.delay();
+				}
+				if (changed & change::sound_timer) {
+					*out++ = c.sound();
+				}
+				if (changed & change::index) {
+					*out++ = (unsigned char) c.index_register();
+					*out++ = (unsigned char) (c.index_register() >> 8u);
+				}
+				if (changed & change::stack_pointer) {
+					*out++ = (unsigned char) c.stack_pointer();
+					*out++ = (unsigned char) (c.stack_pointer() >> 8u);
+				}
+			}
+			for (uint32_t registers = changed >> 4u; registers != 0; registers &= registers - 1) {
+				*out++ = c.registers()[count_trailing_zeros(registers)];
+			}
+
+			fill = out - buffers[active].get();
+			last_pc = pc;
+			++count;
+			//endregion
+		}
+
+		bool writer::close() {
+			if (file == nullptr) {
+				return true;
+			}
+
+			if (fill != 0) {
+				flush_active();
+			}
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			ready.notify_all();
+			thread.join();
+
+			bool ok = !failed && ferror(file) == 0;
+			ok = fclose(file) == 0 && ok;
+			file = nullptr;
+			return ok;
+		}
+
+		void writer::flush_active() {
+			{
+				// Wait for the writer thread to release the other buffer
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [this] { return !pending; });
+				pending = true;
+				pending_index = active;
+				pending_size = fill;
+			}
+			ready.notify_all();
+
+			active ^= 1u;
+			fill = 0;
+		}
+
+		void writer::worker() {
+			for (;;) {
+				unsigned int index;
+				size_t size;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					ready.wait(lock, [this] { return pending || stopping; });
+					if (!pending) {
+						return;
+					}
+					index = pending_index;
+					size = pending_size;
+				}
+
+				const unsigned char *data = buffers[index].get();
+				size_t stored_size = size;
+				unsigned char block_method = stored;
+				if (compress) {
+					size_t packed_size = lz_compress(data, size, packed.get());
+					if (packed_size < size) {
+						data = packed.get();
+						stored_size = packed_size;
+						block_method = lz;
+					}
+				}
+
+				unsigned char header[block_header_size];
+				put_u32(header, (uint32_t) size);
+				put_u32(header + 4, (uint32_t) stored_size);
+				header[8] = block_method;
+				bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+				          fwrite(data, 1, stored_size, file) == stored_size;
+
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					failed = failed || !ok;
+					pending = false;
+				}
+				ready.notify_all();
+			}
+		}
+		//endregion
+		//region Reader
+		reader::~reader() {
+			if (file != nullptr) {
+				fclose(file);
+			}
+		}
+
+		bool reader::open(const char *filename) {
+			file = fopen(filename, "rb");
+			if (file == nullptr) {
+				fprintf(stderr, "cannot open file '%s': %s\n", filename, strerror(errno));
+				return false;
+			}
+
+			char header[sizeof(magic) + 1];
+			if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+			    memcmp(header, magic, sizeof(magic)) != 0 || (unsigned char) header[4] != version) {
+				fprintf(stderr, "'%s' is not a chip8 trace\n", filename);
+				return false;
+			}
+
+			raw.reset(new unsigned char[block_size]);
+			packed.reset(new unsigned char[lz_bound(block_size)]);
+			return true;
+		}
+
+		bool reader::load_block() {
+			unsigned char header[block_header_size];
+			size_t got = fread(header, 1, sizeof(header), file);
+			if (got == 0 && feof(file)) {
+				return false;
+			}
+
+			uint32_t size = get_u32(header);
+			uint32_t stored_size = get_u32(header + 4);
+			if (got != sizeof(header) || size > block_size || stored_size > lz_bound(block_size)) {
+				error = true;
+				return false;
+			}
+
+			if (header[8] == stored && stored_size == size) {
+				error = fread(raw.get(), 1, size, file) != size;
+			} else if (header[8] == lz) {
+				error = fread(packed.get(), 1, stored_size, file) != stored_size ||
+				        !lz_decompress(packed.get(), stored_size, raw.get(), size);
+			} else {
+				error = true;
+			}
+
+			raw_size = size;
+			position = 0;
+			return !error;
+		}
+
+		bool reader::next(record &r) {
+			if (error || file == nullptr) {
+				return false;
+			}
+			while (position == raw_size) {
+				if (!load_block()) {
+					return false;
+				}
+			}
+
+			const unsigned char *in = raw.get() + position;
+			const unsigned char *end = raw.get() + raw_size;
+
+			uint32_t zigzag, changed;
+			if (!get_varint(in, end, zigzag) || end - in < 2) {
+				error = true;
+				return false;
+			}
+			auto delta = (int32_t) (zigzag >> 1u) ^ -(int32_t) (zigzag & 1u);
+			state.pc = (uint16_t) (state.pc + delta);
+			state.opcode = (uint16_t) (in[0] << 8u | in[1]);
+			in += 2;
+			if (!get_varint(in, end, changed)) {
+				error = true;
+				return false;
+			}
+			state.changed = changed;
+
+			// Everything recorded below must be present in this block
+			size_t needed = ((changed & change::delay_timer) ? 1 : 0) + ((changed & change::sound_timer) ? 1 : 0) +
+			                ((changed & change::index) ? 2 : 0) + ((changed & change::stack_pointer) ? 2 : 0);
+			for (unsigned int i = 0; i < 16; ++i) {
+				needed += (changed & (change::v0 << i)) ? 1 : 0;
+			}
+			if ((size_t) (end - in) < needed) {
+				error = true;
+				return false;
+			}
+
+			state.delay_timer = (changed & change::delay_timer) ? *in++ : state.delay_timer > 0 ? state.delay_timer - 1 : 0;
+			state.sound_timer = (changed & change::sound_timer) ? *in++ : state.sound_timer > 0 ? state.sound_timer - 1 : 0;
+			if (changed & change::index) {
+				state.I = (uint16_t) (in[0] | in[1] << 8u);
+				in += 2;
+			}
+			if (changed & change::stack_pointer) {
+				state.sp = (uint16_t) (in[0] | in[1] << 8u);
+				in += 2;
+			}
+			for (unsigned int i = 0; i < 16; ++i) {
+				if (changed & (change::v0 << i)) {
+					state.V[i] = *in++;
+				}
+			}
+
+			position = in - raw.get();
+			r = state;
+			return true;
+		}
+		//endregion
+	}
+}
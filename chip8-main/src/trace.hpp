@@ -0,0 +1,138 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_TRACE
+#define CHIP8_TRACE
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "chip8.hpp"
+
+// Instruction traces: one record per cycle() with the PC, the opcode and the
+// registers it changed.
+//
+// File layout: "C8TR", version byte, then blocks of
+//   uint32 raw size, uint32 packed size, uint8 method (0 stored, 1 LZ), data
+// all little-endian. Inside the raw stream each record is
+//   varint zigzag(pc - previous pc), uint16 opcode, varint change mask,
+//   then one value per set mask bit in bit order (V and timers 1 byte, I and sp 2 bytes).
+// Timers are predicted to count down by one per cycle and only recorded when
+// they do something else, so steady countdowns cost nothing.
+namespace chip8 {
+	namespace trace {
+		enum change : uint32_t {
+			delay_timer = 1u << 0u,
+			sound_timer = 1u << 1u,
+			index = 1u << 2u,            // I
+			stack_pointer = 1u << 3u,
+			v0 = 1u << 4u,               // V0..VF are v0 << X
+		};
+
+		// Largest raw block a writer produces and a reader accepts
+		constexpr size_t block_size = 64u * 1024u;
+
+		struct record {
+			uint16_t pc;                 // Address the instruction was fetched from
+			uint16_t opcode;
+			uint32_t changed;            // change bits
+			// Machine state after the instruction
+			unsigned char V[16];
+			uint16_t I;
+			uint16_t sp;
+			unsigned char delay_timer;
+			unsigned char sound_timer;
+		};
+
+		//region LZ
+		// Byte-oriented LZ77 (LZ4-style sequences). Fast enough to keep up with the
+		// interpreter on the writer thread; no external dependency.
+		constexpr size_t lz_bound(size_t size) { return size + size / 255 + 16; }
+		// `out` must hold lz_bound(size) bytes. Returns the packed size.
+		size_t lz_compress(const unsigned char *in, size_t size, unsigned char *out) noexcept;
+		// Returns false on malformed input or if the output would not be exactly `out_size` bytes.
+		bool lz_decompress(const unsigned char *in, size_t size, unsigned char *out, size_t out_size) noexcept;
+		//endregion
+
+		// Runs an instance while streaming its trace to a file.
+		// Records are encoded into one of two buffers; a full buffer is handed to a
+		// background thread that compresses and writes it while the other one fills.
+		class writer {
+		public:
+			writer() = default;
+			~writer();
+
+			writer(const writer &) = delete;
+			writer &operator=(const writer &) = delete;
+
+			bool open(const char *filename, bool compress = true);
+			// Executes one cycle of `c` and records it.
+			void step(chip8 &c) noexcept;
+			// Flushes outstanding records and joins the writer thread.
+			bool close();
+
+			uint64_t records() const noexcept { return count; }
+
+		private:
+			// zigzag pc varint, opcode, mask varint, V, I, sp, timers
+			static constexpr size_t max_record = 3 + 2 + 3 + 16 + 2 + 2 + 2;
+
+			void flush_active();
+			void worker();
+
+			FILE *file = nullptr;
+			bool compress = true;
+			std::unique_ptr<unsigned char[]> buffers[2];
+			std::unique_ptr<unsigned char[]> packed;
+			unsigned int active = 0;
+			size_t fill = 0;
+
+			//region Writer thread hand-off
+			std::thread thread;
+			std::mutex mutex;
+			std::condition_variable ready;
+			bool pending = false;
+			bool stopping = false;
+			bool failed = false;
+			unsigned int pending_index = 0;
+			size_t pending_size = 0;
+			//endregion
+
+			uint16_t last_pc = 0;
+			bool first = true;
+			uint64_t count = 0;
+		};
+
+		class reader {
+		public:
+			reader() = default;
+			~reader();
+
+			reader(const reader &) = delete;
+			reader &operator=(const reader &) = delete;
+
+			bool open(const char *filename);
+			// Decodes the next record. Returns false at end of trace or on a corrupt file.
+			bool next(record &r);
+			bool corrupt() const noexcept { return error; }
+
+		private:
+			bool load_block();
+
+			FILE *file = nullptr;
+			std::unique_ptr<unsigned char[]> raw;
+			std::unique_ptr<unsigned char[]> packed;
+			size_t raw_size = 0;
+			size_t position = 0;
+			bool error = false;
+
+			record state{};
+		};
+	}
+}
+
+#endif //CHIP8_TRACE
@@ -0,0 +1,74 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "trace.hpp"
+
+int main(int argc, char **argv) {
+	//region Setup
+	if (argc < 2) {
+		printf("Usage: chip8-trace <trace_filename> [--limit N] [--summary]\n\n");
+		return 65;
+	}
+
+	unsigned long long limit = 0;   // 0 = whole trace
+	bool summary = false;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+			limit = strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--summary") == 0) {
+			summary = true;
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+			return 65;
+		}
+	}
+
+	static chip8::trace::reader trace;
+	if (!trace.open(argv[1])) {
+		return 1;
+	}
+	//endregion
+
+	//region Decode
+	chip8::trace::record r{};
+	unsigned long long decoded = 0;
+	while ((limit == 0 || decoded < limit) && trace.next(r)) {
+		++decoded;
+		if (summary) {
+			continue;
+		}
+
+		printf("%03X %04X", r.pc, r.opcode);
+		for (unsigned int i = 0; i < 16; ++i) {
+			if (r.changed & (chip8::trace::change::v0 << i)) {
+				printf(" V%X=%02X", i, r.V[i]);
+			}
+		}
+		if (r.changed & chip8::trace::change::index) {
+			printf(" I=%03X", r.I);
+		}
+		if (r.changed & chip8::trace::change::stack_pointer) {
+			printf(" sp=%X", r.sp);
+		}
+		if (r.changed & chip8::trace::change::delay_timer) {
+			printf(" DT=%02X", r.delay_timer);
+		}
+		if (r.changed & chip8::trace::change::sound_timer) {
+			printf(" ST=%02X", r.sound_timer);
+		}
+		putchar('\n');
+	}
+	//endregion
+
+	if (trace.corrupt()) {
+		fprintf(stderr, "Trace is corrupt after %llu records\n", decoded);
+		return 1;
+	}
+	if (summary) {
+		printf("%llu records\n", decoded);
+	}
+	return 0;
+}
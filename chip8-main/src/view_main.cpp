@@ -0,0 +1,49 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "frame_ring.hpp"
+
+// Renders the newest frame of an instance in the terminal, two pixel rows per text line.
+void draw_frame(const unsigned char *packed, uint64_t seq, uint32_t instance_id) {
+	// Home the cursor instead of clearing to avoid flicker
+	printf("\x1b[H");
+	for (unsigned int y = 0; y < DISPLAY_HEIGHT; y += 2) {
+		for (unsigned int x = 0; x < DISPLAY_WIDTH; ++x) {
+			unsigned int top = (packed[(y * DISPLAY_WIDTH + x) / 8] >> (7u - x % 8u)) & 1u;
+			unsigned int bottom = (packed[((y + 1) * DISPLAY_WIDTH + x) / 8] >> (7u - x % 8u)) & 1u;
+			fputs(top ? (bottom ? "█" : "▀") : (bottom ? "▄" : " "), stdout);
+		}
+		putchar('\n');
+	}
+	printf("instance %u  frame %llu\x1b[K\n", instance_id, (unsigned long long) seq);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		printf("Usage: chip8-view <instance_id>\n\n");
+		return 65;
+	}
+
+	auto instance_id = (uint32_t) strtoul(argv[1], nullptr, 10);
+	chip8::frames::source source;
+	if (!source.open(instance_id)) {
+		return 1;
+	}
+
+	printf("\x1b[2J");
+	unsigned char packed[chip8::frames::frame_bytes];
+	uint64_t shown = 0;
+	for (;;) {
+		uint64_t latest = source.latest();
+		if (latest != shown && source.read(latest, packed)) {
+			draw_frame(packed, latest, instance_id);
+			shown = latest;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(16));
+	}
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include "tables.hpp"
+#include "wall.hpp"
+
+namespace chip8 {
+	namespace wall {
+		layout arrange(size_t count) noexcept {
+			layout grid;
+			while ((size_t) grid.columns * grid.columns < count) {
+				++grid.columns;
+			}
+			grid.rows = (unsigned int) ((count + grid.columns - 1) / grid.columns);
+			if (grid.rows == 0) {
+				grid.rows = 1;
+			}
+			return grid;
+		}
+
+		void raster(const chip8 *const *instances, size_t count, const layout &grid, uint32_t *out) noexcept {
+			const unsigned int stride = grid.width();
+			for (unsigned int tile = 0; tile < grid.columns * grid.rows; ++tile) {
+				uint32_t *origin = out + (tile / grid.columns) * DISPLAY_HEIGHT * stride +
+				                   (tile % grid.columns) * DISPLAY_WIDTH;
+
+				if (tile >= count) {
+					for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y) {
+						for (unsigned int x = 0; x < DISPLAY_WIDTH; ++x) {
+							origin[y * stride + x] = tables::background;
+						}
+					}
+					continue;
+				}
+
+				const unsigned char *pixel = instances[tile]->framebuffer();
+				for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y) {
+					for (unsigned int x = 0; x < DISPLAY_WIDTH; ++x) {
+						origin[y * stride + x] = tables::palette[*pixel++ & 0x1u];
+					}
+				}
+			}
+		}
+	}
+}
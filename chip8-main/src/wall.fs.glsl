@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+flat in int Layer;
+
+uniform usampler2DArray layers;
+uniform vec4 palette[2];
+
+void main()
+{
+	ivec2 texel = min(ivec2(TexCoord), ivec2(63, 31));
+	uint pixel = texelFetch(layers, ivec3(texel, Layer), 0).r & 1u;
+	FragColor = palette[pixel];
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_WALL
+#define CHIP8_WALL
+
+#include <cstddef>
+#include <cstdint>
+
+#include "chip8.hpp"
+
+// Video wall: many instances shown side by side as tiles of one image.
+// The windowed front end draws it on the GPU (wall_view.hpp); raster() is the
+// CPU reference that produces the same image without a GL context.
+namespace chip8 {
+	namespace wall {
+		// Tile grid, filled row by row from the top left
+		struct layout {
+			unsigned int columns = 1;
+			unsigned int rows = 1;
+
+			unsigned int width() const noexcept { return columns * DISPLAY_WIDTH; }
+			unsigned int height() const noexcept { return rows * DISPLAY_HEIGHT; }
+		};
+
+		// ceil(sqrt(count)) columns, so the grid is as square as possible and never taller than wide
+		layout arrange(size_t count) noexcept;
+
+		// Renders the wall at one texel per CHIP-8 pixel into `out`
+		// (width() * height() words, 0xAARRGGBB, row 0 at the top).
+		// Tiles without an instance are filled with the background colour.
+		void raster(const chip8 *const *instances, size_t count, const layout &grid, uint32_t *out) noexcept;
+	}
+}
+
+#endif //CHIP8_WALL
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+
+uniform ivec2 grid;
+
+out vec2 TexCoord;
+flat out int Layer;
+
+void main()
+{
+	// One instance per tile, filled row by row from the top left
+	ivec2 tile = ivec2(gl_InstanceID % grid.x, gl_InstanceID / grid.x);
+	vec2 cell = (vec2(tile) + aCorner) / vec2(grid);
+	gl_Position = vec4(cell.x * 2.0 - 1.0, 1.0 - cell.y * 2.0, 0.0, 1.0);
+	TexCoord = aCorner * vec2(64.0, 32.0);
+	Layer = gl_InstanceID;
+}
\ No newline at end of file
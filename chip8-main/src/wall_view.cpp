@@ -0,0 +1,111 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#include <vector>
+
+#include "tables.hpp"
+#include "wall_view.hpp"
+
+namespace chip8 {
+	namespace wall {
+		// Unit quad, (0, 0) at the top left of a tile
+		constexpr float corners[] = {
+				0.0f, 0.0f,
+				1.0f, 0.0f,
+				1.0f, 1.0f,
+				0.0f, 1.0f,
+		};
+
+		constexpr GLuint indices[] = {
+				0, 1, 3,
+				1, 2, 3,
+		};
+
+		static void unpack_color(uint32_t argb, float *rgba) noexcept {
+			rgba[0] = ((argb >> 16u) & 0xFFu) / 255.0f;
+			rgba[1] = ((argb >> 8u) & 0xFFu) / 255.0f;
+			rgba[2] = (argb & 0xFFu) / 255.0f;
+			rgba[3] = ((argb >> 24u) & 0xFFu) / 255.0f;
+		}
+
+		void view::init(const layout &grid, size_t count, GLuint program) {
+			tiles = grid;
+			layers = count;
+			shader_program = program;
+
+			//region Geometry
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(1, &vbo);
+			glGenBuffers(1, &ebo);
+
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *) nullptr);
+			glEnableVertexAttribArray(0);
+			//endregion
+			//region Layers
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+			// Integer textures must not be filtered
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			// Every layer starts dark, like a freshly cleared gfx buffer
+			std::vector<unsigned char> blank((size_t) DISPLAY_SIZE * count);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8UI, DISPLAY_WIDTH, DISPLAY_HEIGHT, (GLsizei) count, 0,
+			             GL_RED_INTEGER, GL_UNSIGNED_BYTE, blank.data());
+			//endregion
+			//region Uniforms
+			float palette[8];
+			unpack_color(tables::palette[0], palette);
+			unpack_color(tables::palette[1], palette + 4);
+
+			glUseProgram(program);
+			glUniform1i(glGetUniformLocation(program, "layers"), 0);
+			glUniform2i(glGetUniformLocation(program, "grid"), (GLint) grid.columns, (GLint) grid.rows);
+			glUniform4fv(glGetUniformLocation(program, "palette"), 2, palette);
+
+			// Tiles without an instance show the background
+			float background[4];
+			unpack_color(tables::background, background);
+			glClearColor(background[0], background[1], background[2], background[3]);
+			//endregion
+		}
+
+		void view::release() {
+			glDeleteTextures(1, &texture);
+			glDeleteVertexArrays(1, &vao);
+			glDeleteBuffers(1, &vbo);
+			glDeleteBuffers(1, &ebo);
+		}
+
+		size_t view::update(chip8 *const *instances) noexcept {
+			size_t uploaded = 0;
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+			for (size_t i = 0; i < layers; ++i) {
+				if (!instances[i]->draw_pending()) {
+					continue;
+				}
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint) i, DISPLAY_WIDTH, DISPLAY_HEIGHT, 1,
+				                GL_RED_INTEGER, GL_UNSIGNED_BYTE, instances[i]->framebuffer());
+				instances[i]->clear_draw();
+				++uploaded;
+			}
+			return uploaded;
+		}
+
+		void view::draw() const noexcept {
+			glClear(GL_COLOR_BUFFER_BIT);
+			glUseProgram(shader_program);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+			glBindVertexArray(vao);
+			glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, (GLsizei) layers);
+		}
+	}
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2020 udv. All rights reserved.
+
+#ifndef CHIP8_WALL_VIEW
+#define CHIP8_WALL_VIEW
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "chip8.hpp"
+#include "wall.hpp"
+
+namespace chip8 {
+	namespace wall {
+		// GPU wall: each instance's framebuffer is one layer of a GL_TEXTURE_2D_ARRAY
+		// (raw gfx bytes, R8UI), the palette is applied in the fragment shader and
+		// the whole wall is a single instanced draw of one quad.
+		class view {
+		public:
+			// `program` is the linked wall shader (wall.vs.glsl / wall.fs.glsl).
+			void init(const layout &grid, size_t count, GLuint program);
+			void release();
+
+			// Uploads the layers of instances whose draw flag is set and clears
+			// the flag. Returns the number of layers uploaded.
+			size_t update(chip8 *const *instances) noexcept;
+			void draw() const noexcept;
+
+		private:
+			layout tiles;
+			size_t layers = 0;
+
+			GLuint shader_program = 0;
+			GLuint texture = 0;
+			GLuint vao = 0, vbo = 0, ebo = 0;
+		};
+	}
+}
+
+#endif //CHIP8_WALL_VIEW
@@ -3,7 +3,7 @@
 #
 
 # Get upper case system name
-string(TOUPPER SYSTEM_NAME_UPPER)
+string(TOUPPER ${CMAKE_SYSTEM_NAME} SYSTEM_NAME_UPPER)
 
 # Determine architecture (32/64 bit)
 set(X64 OFF)
@@ -18,7 +18,6 @@ endif ()
 
 set(
 		DEFAULT_PROJECT_OPTIONS
-		DEBUG_POSTFIX "d"
 		CXX_STANDARD 17
 		LINKER_LANGUAGE "CXX"
 		POSITION_INDEPENDENT_CODE ON
@@ -31,12 +30,13 @@ set(
 #
 set(
 		DEFAULT_COMPILE_DEFINITIONS
-		SYSTEM_
+		SYSTEM_${SYSTEM_NAME_UPPER}
 )
 
 # MSVC compiler options
-if ("" MATCHES "MSVC")
+if ("${CMAKE_CXX_COMPILER_ID}" MATCHES "MSVC")
 	set(DEFAULT_COMPILE_DEFINITIONS
+			${DEFAULT_COMPILE_DEFINITIONS}
 			_SCL_SECURE_NO_WARNINGS  # Calling any one of the potentially unsafe methods in the Standard C++ Library
 			_CRT_SECURE_NO_WARNINGS  # Calling any one of the potentially unsafe methods in the CRT Library
 			)
@@ -49,7 +49,7 @@ endif ()
 set(DEFAULT_COMPILE_OPTIONS)
 
 # MSVC compiler options
-if ("" MATCHES "MSVC")
+if ("${CMAKE_CXX_COMPILER_ID}" MATCHES "MSVC")
 	set(
 			DEFAULT_COMPILE_OPTIONS
 			PRIVATE
@@ -79,7 +79,7 @@ if ("" MATCHES "MSVC")
 endif ()
 
 # GCC and Clang compiler options
-if ("" MATCHES "GNU" OR "" MATCHES "Clang")
+if ("${CMAKE_CXX_COMPILER_ID}" MATCHES "GNU" OR "${CMAKE_CXX_COMPILER_ID}" MATCHES "Clang")
 	set(
 			DEFAULT_COMPILE_OPTIONS
 			PRIVATE
@@ -112,20 +112,10 @@ if ("" MATCHES "GNU" OR "" MATCHES "Clang")
 			# -Wreturn-stack-address # gives false positives
 			>
 
-			$<$<BOOL:>:
-			-fprofile-arcs
-			-ftest-coverage
-			>
-
 			PUBLIC
 			$<$<PLATFORM_ID:Darwin>:
 			-pthread
 			>
-
-			# Required for CMake < 3.1; should be removed if minimum required CMake version is raised.
-			$<$<VERSION_LESS:,3.1>:
-			-std=c++11
-			>
 	)
 endif ()
 
@@ -136,21 +126,108 @@ endif ()
 set(DEFAULT_LINKER_OPTIONS)
 
 # Use pthreads on mingw and linux
-if ("" MATCHES "GNU" OR "" MATCHES "Linux")
+if ("${CMAKE_CXX_COMPILER_ID}" MATCHES "GNU" OR "${CMAKE_SYSTEM_NAME}" MATCHES "Linux")
 	set(
 			DEFAULT_LINKER_OPTIONS
 			PUBLIC
 
 			-pthread
 	)
+endif ()
+
+
+#
+# Performance profiles
+#
+
+option(CHIP8_ENABLE_LTO "Link-time optimization for optimized configurations" OFF)
+option(CHIP8_NATIVE_ARCH "Tune code for the build machine (-march=native)" OFF)
+set(CHIP8_SANITIZE "" CACHE STRING "Sanitizers to enable, e.g. \"address,undefined\" (GCC/Clang)")
+set(CHIP8_PGO "OFF" CACHE STRING "Profile-guided optimization stage: OFF, GENERATE or USE")
+set_property(CACHE CHIP8_PGO PROPERTY STRINGS OFF GENERATE USE)
+set(CHIP8_PGO_DIR "${CMAKE_BINARY_DIR}/pgo" CACHE PATH "Directory for PGO profile data")
+
+set(CHIP8_GNU_LIKE OFF)
+if ("${CMAKE_CXX_COMPILER_ID}" MATCHES "GNU" OR "${CMAKE_CXX_COMPILER_ID}" MATCHES "Clang")
+	set(CHIP8_GNU_LIKE ON)
+endif ()
 
-	if ()
-		set(
-				DEFAULT_LINKER_OPTIONS
-				PUBLIC
+set(PERFORMANCE_COMPILE_OPTIONS)
+set(PERFORMANCE_LINKER_OPTIONS)
+
+# Link-time optimization
+if (CHIP8_ENABLE_LTO)
+	include(CheckIPOSupported)
+	check_ipo_supported(RESULT CHIP8_IPO_SUPPORTED OUTPUT CHIP8_IPO_OUTPUT LANGUAGES CXX)
+	if (CHIP8_IPO_SUPPORTED)
+		set(CMAKE_INTERPROCEDURAL_OPTIMIZATION_RELEASE ON)
+		set(CMAKE_INTERPROCEDURAL_OPTIMIZATION_RELWITHDEBINFO ON)
+	else ()
+		message(WARNING "LTO requested but not supported: ${CHIP8_IPO_OUTPUT}")
+	endif ()
+endif ()
 
-				-fprofile-arcs
-				-ftest-coverage
-		)
+# Native architecture
+if (CHIP8_NATIVE_ARCH)
+	if (CHIP8_GNU_LIKE)
+		list(APPEND PERFORMANCE_COMPILE_OPTIONS -march=native)
+	else ()
+		message(WARNING "CHIP8_NATIVE_ARCH is only supported with GCC and Clang")
+	endif ()
+endif ()
+
+# Sanitizers
+if (NOT "${CHIP8_SANITIZE}" STREQUAL "")
+	if (CHIP8_GNU_LIKE)
+		list(APPEND PERFORMANCE_COMPILE_OPTIONS -fsanitize=${CHIP8_SANITIZE} -fno-omit-frame-pointer -fno-sanitize-recover=all)
+		list(APPEND PERFORMANCE_LINKER_OPTIONS -fsanitize=${CHIP8_SANITIZE})
+	else ()
+		message(WARNING "CHIP8_SANITIZE is only supported with GCC and Clang")
+	endif ()
+endif ()
+
+# Profile-guided optimization
+# GENERATE: build, then run the `pgo-train` target. USE: rebuild against the collected profile.
+set(CHIP8_PGO_PROFILE "${CHIP8_PGO_DIR}")
+if ("${CMAKE_CXX_COMPILER_ID}" MATCHES "Clang")
+	set(CHIP8_PGO_PROFILE "${CHIP8_PGO_DIR}/chip8.profdata")
+endif ()
+
+if (CHIP8_PGO STREQUAL "GENERATE")
+	if (CHIP8_GNU_LIKE)
+		list(APPEND PERFORMANCE_COMPILE_OPTIONS -fprofile-generate=${CHIP8_PGO_DIR})
+		list(APPEND PERFORMANCE_LINKER_OPTIONS -fprofile-generate=${CHIP8_PGO_DIR})
+	else ()
+		message(WARNING "CHIP8_PGO is only supported with GCC and Clang")
+	endif ()
+elseif (CHIP8_PGO STREQUAL "USE")
+	if (CHIP8_GNU_LIKE)
+		list(APPEND PERFORMANCE_COMPILE_OPTIONS -fprofile-use=${CHIP8_PGO_PROFILE})
+		if ("${CMAKE_CXX_COMPILER_ID}" MATCHES "GNU")
+			list(APPEND PERFORMANCE_COMPILE_OPTIONS -fprofile-correction -Wno-missing-profile)
+		endif ()
+		list(APPEND PERFORMANCE_LINKER_OPTIONS -fprofile-use=${CHIP8_PGO_PROFILE})
+	else ()
+		message(WARNING "CHIP8_PGO is only supported with GCC and Clang")
+	endif ()
+elseif (NOT CHIP8_PGO STREQUAL "OFF")
+	message(FATAL_ERROR "CHIP8_PGO must be OFF, GENERATE or USE (got '${CHIP8_PGO}')")
+endif ()
+
+
+#
+# Apply defaults to a target
+#
+
+function(chip8_target_defaults TARGET)
+	set_target_properties(${TARGET} PROPERTIES ${DEFAULT_PROJECT_OPTIONS})
+	target_compile_definitions(${TARGET} PRIVATE ${DEFAULT_COMPILE_DEFINITIONS})
+	if (DEFAULT_COMPILE_OPTIONS)
+		target_compile_options(${TARGET} ${DEFAULT_COMPILE_OPTIONS})
+	endif ()
+	target_compile_options(${TARGET} PRIVATE ${PERFORMANCE_COMPILE_OPTIONS})
+	if (DEFAULT_LINKER_OPTIONS)
+		target_link_libraries(${TARGET} ${DEFAULT_LINKER_OPTIONS})
 	endif ()
-endif ()
\ No newline at end of file
+	target_link_options(${TARGET} PRIVATE ${PERFORMANCE_LINKER_OPTIONS})
+endfunction()
@@ -0,0 +1,34 @@
+#
+# Embeds GLSL sources into a C++ header (run with cmake -P)
+#
+#   -D OUTPUT=<header> -D INPUTS=<file|file|...>
+#
+# Each file becomes `constexpr const char <name>[]` in chip8::shaders, where
+# <name> is the file name with dots replaced by underscores and the .glsl
+# extension dropped (texture.vs.glsl -> texture_vs).
+#
+
+if (NOT OUTPUT OR NOT INPUTS)
+	message(FATAL_ERROR "embedShaders: OUTPUT and INPUTS are required")
+endif ()
+
+set(CONTENT "// Generated by cmake/embedShaders.cmake; do not edit.\n\n")
+string(APPEND CONTENT "#ifndef CHIP8_EMBEDDED_SHADERS\n#define CHIP8_EMBEDDED_SHADERS\n\n")
+string(APPEND CONTENT "namespace chip8 {\n\tnamespace shaders {\n")
+
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+foreach (INPUT ${INPUTS})
+	get_filename_component(NAME ${INPUT} NAME)
+	string(REGEX REPLACE "\\.glsl$" "" NAME ${NAME})
+	string(REPLACE "." "_" NAME ${NAME})
+
+	file(READ ${INPUT} SOURCE)
+	string(APPEND CONTENT "\t\tconstexpr const char ${NAME}[] = R\"glsl(${SOURCE})glsl\";\n")
+endforeach ()
+
+string(APPEND CONTENT "\t}\n}\n\n#endif //CHIP8_EMBEDDED_SHADERS\n")
+
+# Only touch the header when the shaders changed, so dependents do not rebuild needlessly
+file(WRITE ${OUTPUT}.tmp "${CONTENT}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)